@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+#include "terrain.h"
+#include "occupancy.h"
+#include "occlusion.h"
+#include "mesh.h"
+#include "edit.h"
+#include "cache.h"
+#include "rng.h"
+#include "thread.h"
+#include "metrics.h"
+#include "util.h"
+
+// Globals
+
+int mesh_flags = 0;
+int edit_amount = 0;
+char *cache_directory = NULL;
+char *metrics_file = NULL;
+bool noise_heights = false;
+bool verify = false;
+
+// Functions
+
+long peak_rss() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	// Darwin reports bytes, everyone else kilobytes
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+unsigned long long checksum_vertices() {
+	// Sum of per-vertex FNV-1a hashes, so the order vertices were emitted in doesn't matter
+	unsigned long long sum = 0;
+	for(unsigned int i = 0; i < vertex_amount; i++) {
+		const unsigned char *bytes = (const unsigned char *) (vertex_buffer_data + i);
+		unsigned long long hash = 14695981039346656037ULL;
+		for(size_t j = 0; j < sizeof(struct vertex); j++) {
+			hash = (hash ^ bytes[j]) * 1099511628211ULL;
+		}
+		sum += hash;
+	}
+	return sum;
+}
+
+void report(const char *world_name, int iteration, const char *phase, double start, unsigned long long rays, unsigned int vertices, unsigned long long checksum) {
+	double wall_ms = (current_time() - start) * 1000.0;
+	double ns_per_voxel = wall_ms * 1000000.0 / (double) WORLD_SIZE_XYZ;
+	printf("%s,%d,%s,%.3f,%.3f,%ld,%llu,%u,%016llx\n", world_name, iteration, phase, wall_ms, ns_per_voxel, peak_rss(), rays, vertices, checksum);
+	fflush(stdout);
+}
+
+// Compare the occlusion with what the scalar reference kernel makes of it
+void verify_bake(const char *world_name, int iteration, const char *phase) {
+	double start = current_time();
+	unsigned int max_difference;
+	unsigned int mismatches = verify_occlusion(&max_difference);
+	fprintf(stderr, "%u of %u occlusion slots differ from the scalar kernel, by at most %u/255\n", mismatches, occlusion_slot_amount - 1, max_difference);
+	report(world_name, iteration, phase, start, 0, mismatches, 0);
+}
+
+void bake(struct bench_world *bench_world, int iteration) {
+	const char *name = bench_world->name;
+
+	double total = current_time();
+	double start = current_time();
+	if(bench_world->height_map_file != NULL) {
+		load_height_map(bench_world->height_map_file, bench_world->size_y);
+	} else {
+		set_world_size(bench_world->size_x, bench_world->size_y, bench_world->size_z);
+		if(noise_heights) {
+			create_noise_height_map();
+		} else {
+			create_random_height_map();
+		}
+	}
+	report(name, iteration, "height_map", start, 0, 0, 0);
+	fprintf(stderr, "World size: %dx%dx%d\n", world_size_x, world_size_y, world_size_z);
+
+	start = current_time();
+	populate_world();
+	build_occupancy();
+	report(name, iteration, "blocks", start, 0, 0, 0);
+
+	rays_traced = 0;
+	cells_visited = 0;
+	start = current_time();
+	if(cache_directory != NULL && load_baked_world(cache_directory, mesh_flags)) {
+		report(name, iteration, "cache_load", start, 0, vertex_amount, 0);
+	} else {
+		calculate_occlusion();
+		if(rays_traced > 0) {
+			fprintf(stderr, "%.1f cells visited per ray\n", (double) cells_visited / (double) rays_traced);
+		}
+		report_block_memory();
+		report(name, iteration, "occlusion", start, rays_traced, 0, 0);
+
+		start = current_time();
+		fill_vertex_buffer(mesh_flags);
+		report(name, iteration, "vertex_buffer", start, 0, vertex_amount, 0);
+
+		if(cache_directory != NULL) {
+			start = current_time();
+			save_baked_world(cache_directory, mesh_flags);
+			report(name, iteration, "cache_save", start, 0, vertex_amount, 0);
+		}
+	}
+
+	report(name, iteration, "total", total, rays_traced, vertex_amount, checksum_vertices());
+
+	if(verify) {
+		verify_bake(name, iteration, "verify");
+	}
+
+	// Dig out or build on top of random columns, one block at a time
+	if(edit_amount > 0) {
+		start = current_time();
+		rays_traced = 0;
+		double slowest = 0.0;
+		struct rng rng;
+		init_rng(&rng, world_seed, RNG_STREAM_EDITS);
+		for(int i = 0; i < edit_amount; i++) {
+			int x = (int) random_below(next_random(&rng), (unsigned int) world_size_x);
+			int z = (int) random_below(next_random(&rng), (unsigned int) world_size_z);
+			int y = world_size_y - 1;
+			while(y >= 0 && !is_solid(x, y, z)) {
+				y--;
+			}
+			struct edit edit;
+			if((next_random(&rng) & 1) == 0 && y >= 0) {
+				edit_block(x, y, z, TYPE_AIR, &edit);
+			} else {
+				edit_block(x, y + 1, z, TYPE_STONE, &edit);
+			}
+			if(edit.seconds > slowest) {
+				slowest = edit.seconds;
+			}
+			free_edit(&edit);
+		}
+		fprintf(stderr, "%d edits: %.3f ms on average, %.3f ms at most\n", edit_amount, (current_time() - start) * 1000.0 / edit_amount, slowest * 1000.0);
+		report(name, iteration, "edits", start, rays_traced, vertex_amount, checksum_vertices());
+
+		// The edits only recalculated the blocks they could reach
+		if(verify) {
+			verify_bake(name, iteration, "verify_edits");
+		}
+	}
+
+	free_vertex_buffer();
+	close_baked_world();
+	free_occupancy();
+	free_terrain();
+}
+
+int main(int argc, char **argv) {
+	// Parse options; every -d and -m adds a world to bake
+	struct bench_world worlds[MAX_WORLDS];
+	int world_amount = 0;
+	int iterations = 1;
+	uint64_t seed = 1;
+	int threads = 0;
+	int c;
+	while((c = getopt(argc, argv, "n:s:m:t:d:e:c:k:M:gTNV")) != -1) {
+		switch(c) {
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'm':
+			case 'd':
+				if(world_amount == MAX_WORLDS) {
+					fprintf(stderr, "Too many worlds (at most %d)\n", MAX_WORLDS);
+					return 1;
+				}
+				struct bench_world *bench_world = &worlds[world_amount++];
+				bench_world->name = optarg;
+				bench_world->height_map_file = NULL;
+				bench_world->size_x = bench_world->size_y = bench_world->size_z = 0;
+				if(c == 'm') {
+					bench_world->height_map_file = optarg;
+				} else if(!parse_world_size(optarg, &bench_world->size_x, &bench_world->size_y, &bench_world->size_z)) {
+					fprintf(stderr, "Invalid world size %s (expected XxYxZ, at most %d blocks along each axis)\n", optarg, MAX_WORLD_SIZE);
+					return 1;
+				}
+				break;
+			case 't':
+				threads = atoi(optarg);
+				break;
+			case 'e':
+				edit_amount = atoi(optarg);
+				break;
+			case 'c':
+				cache_directory = optarg;
+				break;
+			case 'g':
+				mesh_flags |= MESH_GREEDY;
+				break;
+			case 'T':
+				mesh_flags |= MESH_TEXTURED;
+				break;
+			case 'N':
+				noise_heights = true;
+				break;
+			case 'k':
+				if(!set_occlusion_kernel(optarg)) {
+					fprintf(stderr, "Unknown or unsupported occlusion kernel %s (expected scalar, table, avx2, pyramid or heightmap)\n", optarg);
+					return 1;
+				}
+				break;
+			case 'V':
+				verify = true;
+				break;
+			case 'M':
+				metrics_file = optarg;
+				break;
+			case '?':
+			default:
+				fprintf(stderr, "Usage: %s [-n iterations] [-s seed] [-t threads] [-e edits] [-c cache_directory] [-k kernel] [-M metrics_file] [-V] [-g] [-T] [-N] [-d XxYxZ | -m height_map]...\n", argv[0]);
+				return 1;
+		}
+	}
+	if(iterations < 1) {
+		fprintf(stderr, "Invalid amount of iterations\n");
+		return 1;
+	}
+	if(world_amount == 0) {
+		struct bench_world *bench_world = &worlds[world_amount++];
+		bench_world->name = "default";
+		bench_world->height_map_file = NULL;
+		bench_world->size_x = DEFAULT_WORLD_SIZE_X;
+		bench_world->size_y = DEFAULT_WORLD_SIZE_Y;
+		bench_world->size_z = DEFAULT_WORLD_SIZE_Z;
+	}
+
+	set_thread_amount(threads);
+	fprintf(stderr, "Baking %d worlds %d times using %d threads\n", world_amount, iterations, thread_amount);
+
+	// Machine-readable results go to stdout, progress to stderr
+	printf("world,iteration,phase,wall_ms,ns_per_voxel,peak_rss_kb,rays,vertices,checksum\n");
+
+	for(int w = 0; w < world_amount; w++) {
+		for(int i = 1; i <= iterations; i++) {
+			// Every iteration generates the same world
+			set_world_seed(seed);
+			bake(&worlds[w], i);
+		}
+	}
+
+	// Totals over every bake, to compare runs with
+	if(metrics_file != NULL && !dump_metrics(metrics_file)) {
+		return 1;
+	}
+
+	return 0;
+}
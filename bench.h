@@ -0,0 +1,20 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#define MAX_WORLDS 64
+
+struct bench_world {
+	const char *name;
+	char *height_map_file;
+	int size_x;
+	int size_y;
+	int size_z;
+};
+
+static long peak_rss(void);
+static unsigned long long checksum_vertices(void);
+static void report(const char *world_name, int iteration, const char *phase, double start, unsigned long long rays, unsigned int vertices, unsigned long long checksum);
+static void verify_bake(const char *world_name, int iteration, const char *phase);
+static void bake(struct bench_world *bench_world, int iteration);
+
+#endif /* !defined _BENCH_H */
@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "terrain.h"
+#include "occlusion.h"
+#include "mesh.h"
+#include "cache.h"
+
+#define CACHE_MAGIC "STONEBAK"
+#define SECTION_ALIGNMENT 16
+
+// A baked world file is this header followed by its sections, each aligned to SECTION_ALIGNMENT bytes
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	int32_t size[3];
+	uint64_t key;
+	uint32_t occlusion_slot_amount;
+	uint32_t vertex_amount;
+	uint64_t chunk_amount;
+	uint64_t slots_offset;	// struct occlusion per slot
+	uint64_t slot_blocks_offset;	// uint64_t block index (x + y * size_x + z * size_x * size_y) per slot
+	uint64_t offsets_offset;	// face_vertex_offsets
+	uint64_t bounds_offset;	// chunk_bounds
+	uint64_t vertices_offset;	// struct vertex per vertex
+	uint64_t file_size;
+};
+
+// Globals
+
+static void *mapping = NULL;
+static size_t mapping_size = 0;
+
+// Util functions
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length) {
+	// FNV-1a
+	const unsigned char *bytes = (const unsigned char *) data;
+	for(size_t i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Everything a bake depends on; the record sizes catch layout changes nobody bumped the version for
+static uint64_t cache_key(int mesh_flags) {
+	int32_t values[] = {CACHE_VERSION, world_size_x, world_size_y, world_size_z, (int32_t) terrain_seed, RAY_AMOUNT, ray_length, mesh_flags, (int32_t) sizeof(struct vertex), (int32_t) sizeof(struct occlusion), (int32_t) sizeof(struct mesh_bounds)};
+	uint64_t map = hash_height_map();
+	uint64_t hash = hash_bytes(14695981039346656037ULL, values, sizeof(values));
+	return hash_bytes(hash, &map, sizeof(map));
+}
+
+// Room for "/", 16 hex digits, ".bake" and a terminator; the temporary name appends ".<pid>" to it
+#define CACHE_FILENAME_EXTRA 64
+
+static char *cache_filename(const char *directory, uint64_t key) {
+	size_t size = strlen(directory) + CACHE_FILENAME_EXTRA;
+	char *filename = (char *) malloc(size);
+	if(filename == NULL) {
+		fprintf(stderr, "Could not allocate cache filename\n");
+		exit(1);
+	}
+	snprintf(filename, size, "%s/%016llx.bake", directory, (unsigned long long) key);
+	return filename;
+}
+
+static uint64_t align_section(uint64_t offset) {
+	return (offset + SECTION_ALIGNMENT - 1) & ~(uint64_t) (SECTION_ALIGNMENT - 1);
+}
+
+// Place the sections one after another, from the amounts in the header
+static void lay_out_sections(struct cache_header *header) {
+	header->slots_offset = align_section(sizeof(struct cache_header));
+	header->slot_blocks_offset = align_section(header->slots_offset + sizeof(struct occlusion) * header->occlusion_slot_amount);
+	header->offsets_offset = align_section(header->slot_blocks_offset + sizeof(uint64_t) * header->occlusion_slot_amount);
+	header->bounds_offset = align_section(header->offsets_offset + sizeof(unsigned int) * (header->chunk_amount * FACE_AMOUNT + 1));
+	header->vertices_offset = align_section(header->bounds_offset + sizeof(struct mesh_bounds) * header->chunk_amount);
+	header->file_size = header->vertices_offset + sizeof(struct vertex) * header->vertex_amount;
+}
+
+static void *get_section(void *data, uint64_t offset) {
+	return (char *) data + offset;
+}
+
+static bool write_section(FILE *file, uint64_t offset, const void *data, size_t length) {
+	return fseek(file, (long) offset, SEEK_SET) == 0 && fwrite(data, 1, length, file) == length;
+}
+
+// Block index of the AIR block using every occlusion slot
+static uint64_t *find_slot_blocks(void) {
+	uint64_t *blocks = (uint64_t *) calloc(occlusion_slot_amount, sizeof(uint64_t));
+	if(blocks == NULL) {
+		fprintf(stderr, "Could not allocate %u slot positions\n", occlusion_slot_amount);
+		exit(1);
+	}
+
+	// Only chunks with their own storage have blocks with a slot
+	for(int cz = 0; cz < chunks_z; cz++) {
+		for(int cy = 0; cy < chunks_y; cy++) {
+			for(int cx = 0; cx < chunks_x; cx++) {
+				if(get_chunk(cx, cy, cz)->blocks == NULL) {
+					continue;
+				}
+				for(int z = cz * CHUNK_SIZE; z < (cz + 1) * CHUNK_SIZE && z < world_size_z; z++) {
+					for(int y = cy * CHUNK_SIZE; y < (cy + 1) * CHUNK_SIZE && y < world_size_y; y++) {
+						for(int x = cx * CHUNK_SIZE; x < (cx + 1) * CHUNK_SIZE && x < world_size_x; x++) {
+							struct block block = get_block(x, y, z);
+							if(block.type == TYPE_AIR && block.data != 0) {
+								blocks[block.data] = (uint64_t) x + (uint64_t) world_size_x * ((uint64_t) y + (uint64_t) world_size_y * (uint64_t) z);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return blocks;
+}
+
+// Give every block its slot back; false if one of them is not an AIR block without slot
+static bool restore_slot_blocks(const uint64_t *blocks, unsigned int amount) {
+	allocate_occlusion_slots(amount);
+	for(unsigned int slot = 1; slot < amount; slot++) {
+		uint64_t index = blocks[slot];
+		if(index >= WORLD_SIZE_XYZ) {
+			return false;
+		}
+		int x = (int) (index % (uint64_t) world_size_x);
+		int y = (int) (index / (uint64_t) world_size_x % (uint64_t) world_size_y);
+		int z = (int) (index / ((uint64_t) world_size_x * (uint64_t) world_size_y));
+		struct block block = get_block(x, y, z);
+		if(block.type != TYPE_AIR || block.data != 0) {
+			return false;
+		}
+		block.data = slot & BLOCK_DATA_MASK;
+		set_block(x, y, z, block);
+	}
+	return true;
+}
+
+// Functions
+
+uint64_t hash_height_map() {
+	return hash_bytes(14695981039346656037ULL, height_map, sizeof(int) * WORLD_SIZE_XZ);
+}
+
+// Take occlusion and vertices from the cache instead of baking them; the world's blocks must be populated already
+bool load_baked_world(const char *directory, int mesh_flags) {
+	uint64_t key = cache_key(mesh_flags);
+	char *filename = cache_filename(directory, key);
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) {
+		fprintf(stderr, "No baked world in %s\n", filename);
+		free(filename);
+		return false;
+	}
+
+	struct stat status;
+	void *data = MAP_FAILED;
+	if(fstat(fd, &status) == 0 && (size_t) status.st_size >= sizeof(struct cache_header)) {
+		data = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if(data == MAP_FAILED) {
+		fprintf(stderr, "Could not map baked world %s\n", filename);
+		free(filename);
+		return false;
+	}
+
+	// Anything that doesn't match exactly is a miss
+	struct cache_header *header = (struct cache_header *) data;
+	struct cache_header expected = *header;
+	lay_out_sections(&expected);
+	bool valid =
+		memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+		header->version == CACHE_VERSION &&
+		header->key == key &&
+		header->size[0] == world_size_x && header->size[1] == world_size_y && header->size[2] == world_size_z &&
+		header->chunk_amount == CHUNK_AMOUNT &&
+		header->occlusion_slot_amount > 0 &&
+		memcmp(header, &expected, sizeof(expected)) == 0 &&
+		header->file_size == (uint64_t) status.st_size;
+	if(valid) {
+		valid = restore_slot_blocks((const uint64_t *) get_section(data, header->slot_blocks_offset), header->occlusion_slot_amount);
+	}
+	if(!valid) {
+		fprintf(stderr, "Ignoring stale baked world %s\n", filename);
+		munmap(data, (size_t) status.st_size);
+		free(filename);
+		return false;
+	}
+
+	memcpy(occlusion_slots, get_section(data, header->slots_offset), sizeof(struct occlusion) * occlusion_slot_amount);
+	use_vertex_buffer((struct vertex *) get_section(data, header->vertices_offset), header->vertex_amount, (const unsigned int *) get_section(data, header->offsets_offset), (const struct mesh_bounds *) get_section(data, header->bounds_offset), mesh_flags);
+
+	// The vertices stay mapped for as long as they're in use
+	close_baked_world();
+	mapping = data;
+	mapping_size = (size_t) status.st_size;
+
+	fprintf(stderr, "Loaded baked world %s (%f MB)\n", filename, (float) mapping_size / (1024 * 1024));
+	free(filename);
+	return true;
+}
+
+void save_baked_world(const char *directory, int mesh_flags) {
+	if(mkdir(directory, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Could not create cache directory %s\n", directory);
+		return;
+	}
+
+	size_t chunk_amount = CHUNK_AMOUNT;
+	struct cache_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.size[0] = world_size_x;
+	header.size[1] = world_size_y;
+	header.size[2] = world_size_z;
+	header.key = cache_key(mesh_flags);
+	header.occlusion_slot_amount = occlusion_slot_amount;
+	header.vertex_amount = vertex_amount;
+	header.chunk_amount = chunk_amount;
+	lay_out_sections(&header);
+
+	// Write to a temporary file first, so a half-written file never has the real name
+	char *filename = cache_filename(directory, header.key);
+	size_t temporary_size = strlen(filename) + CACHE_FILENAME_EXTRA;
+	char *temporary = (char *) malloc(temporary_size);
+	if(temporary == NULL) {
+		fprintf(stderr, "Could not allocate cache filename\n");
+		exit(1);
+	}
+	snprintf(temporary, temporary_size, "%s.%d", filename, (int) getpid());
+	uint64_t *slot_blocks = find_slot_blocks();
+	FILE *file = fopen(temporary, "wb");
+	bool written =
+		file != NULL &&
+		write_section(file, 0, &header, sizeof(header)) &&
+		write_section(file, header.slots_offset, occlusion_slots, sizeof(struct occlusion) * occlusion_slot_amount) &&
+		write_section(file, header.slot_blocks_offset, slot_blocks, sizeof(uint64_t) * occlusion_slot_amount) &&
+		write_section(file, header.offsets_offset, face_vertex_offsets, sizeof(unsigned int) * (chunk_amount * FACE_AMOUNT + 1)) &&
+		write_section(file, header.bounds_offset, chunk_bounds, sizeof(struct mesh_bounds) * chunk_amount) &&
+		write_section(file, header.vertices_offset, vertex_buffer_data, sizeof(struct vertex) * vertex_amount);
+	if(file != NULL && fclose(file) != 0) {
+		written = false;
+	}
+	if(written && rename(temporary, filename) == 0) {
+		fprintf(stderr, "Saved baked world %s (%f MB)\n", filename, (float) header.file_size / (1024 * 1024));
+	} else {
+		fprintf(stderr, "Could not save baked world %s\n", filename);
+		unlink(temporary);
+	}
+	free(slot_blocks);
+	free(temporary);
+	free(filename);
+}
+
+// Only once nothing uses the loaded vertices anymore
+void close_baked_world() {
+	if(mapping != NULL) {
+		munmap(mapping, mapping_size);
+		mapping = NULL;
+		mapping_size = 0;
+	}
+}
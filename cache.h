@@ -0,0 +1,15 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bump when the file layout or anything that goes into a bake changes
+#define CACHE_VERSION 2
+
+uint64_t hash_height_map(void);
+bool load_baked_world(const char *directory, int mesh_flags);
+void save_baked_world(const char *directory, int mesh_flags);
+void close_baked_world(void);
+
+#endif /* !defined _CACHE_H */
@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "terrain.h"
+#include "occupancy.h"
+#include "occlusion.h"
+#include "mesh.h"
+#include "util.h"
+#include "metrics.h"
+#include "edit.h"
+
+// Growing list of block indices
+struct block_list {
+	size_t *indices;
+	unsigned int amount;
+	unsigned int capacity;
+};
+
+// Util functions
+
+static inline size_t get_block_index(int x, int y, int z) {
+	return (size_t) x + (size_t) world_size_x * ((size_t) y + (size_t) world_size_y * (size_t) z);
+}
+
+static void add_to_list(struct block_list *list, size_t index) {
+	if(list->amount == list->capacity) {
+		list->capacity = list->capacity * 2 + 256;
+		size_t *new_indices = (size_t *) realloc(list->indices, sizeof(size_t) * list->capacity);
+		if(new_indices == NULL) {
+			fprintf(stderr, "Could not allocate a list of %u blocks\n", list->capacity);
+			exit(1);
+		}
+		list->indices = new_indices;
+	}
+	list->indices[list->amount++] = index;
+}
+
+static void add_block(int x, int y, int z, void *data) {
+	add_to_list((struct block_list *) data, get_block_index(x, y, z));
+}
+
+static int compare_indices(const void *a, const void *b) {
+	size_t first = *(const size_t *) a;
+	size_t second = *(const size_t *) b;
+	return (first > second) - (first < second);
+}
+
+// Faces belong to the chunk of the solid block they're on
+static void mark_chunk(bool *marked, int x, int y, int z) {
+	if(is_solid_inside(x, y, z)) {
+		marked[(x >> CHUNK_SHIFT) + chunks_x * ((y >> CHUNK_SHIFT) + chunks_y * (z >> CHUNK_SHIFT))] = true;
+	}
+}
+
+// Functions
+
+// Change the type of one block, and update the occlusion and vertex buffer around it; free_edit() releases the result
+bool edit_block(int x, int y, int z, unsigned int type, struct edit *edit) {
+	double start = current_time();
+	edit->blocks = NULL;
+	edit->block_amount = 0;
+	edit->chunk_amount = 0;
+	edit->first_vertex = vertex_amount;
+	edit->seconds = 0.0;
+
+	if(!is_inside(x, y, z) || get_block(x, y, z).type == type) {
+		return false;
+	}
+
+	// New blocks start without occlusion slot; STONE blocks don't need one
+	struct block block = {type & 0xFF, 0};
+	set_block(x, y, z, block);
+	set_solid(x, y, z, type != TYPE_AIR);
+	world_matches_height_map = false;
+
+	struct block_list list = {NULL, 0, 0};
+
+	// The edited block may change colour, and AIR blocks around it may have gained a solid neighbor
+	add_to_list(&list, get_block_index(x, y, z));
+	add_occlusion_slot(x, y, z);
+	int neighbors[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+	for(int i = 0; i < 6; i++) {
+		int nx = x + neighbors[i][0];
+		int ny = y + neighbors[i][1];
+		int nz = z + neighbors[i][2];
+		if(is_inside(nx, ny, nz) && add_occlusion_slot(nx, ny, nz)) {
+			add_to_list(&list, get_block_index(nx, ny, nz));
+		}
+	}
+
+	// Every block with a ray reaching the edited one sees more or less light now
+	for_each_ray_source(x, y, z, add_block, &list);
+
+	// Rays from one block can cross the edited block more than once
+	qsort(list.indices, list.amount, sizeof(size_t), compare_indices);
+	unsigned int unique = 0;
+	for(unsigned int i = 0; i < list.amount; i++) {
+		if(unique == 0 || list.indices[i] != list.indices[unique - 1]) {
+			list.indices[unique++] = list.indices[i];
+		}
+	}
+	list.amount = unique;
+
+	occlude_blocks(list.indices, list.amount);
+
+	// Faces next to a listed block show its colour or occlusion
+	bool *marked = (bool *) calloc(CHUNK_AMOUNT, sizeof(bool));
+	if(marked == NULL) {
+		fprintf(stderr, "Could not allocate chunk marks\n");
+		exit(1);
+	}
+	for(unsigned int i = 0; i < list.amount; i++) {
+		size_t index = list.indices[i];
+		int bx = (int) (index % (size_t) world_size_x);
+		int by = (int) (index / (size_t) world_size_x % (size_t) world_size_y);
+		int bz = (int) (index / ((size_t) world_size_x * (size_t) world_size_y));
+		mark_chunk(marked, bx, by, bz);
+		for(int j = 0; j < 6; j++) {
+			mark_chunk(marked, bx + neighbors[j][0], by + neighbors[j][1], bz + neighbors[j][2]);
+		}
+	}
+
+	int *chunk_indices = (int *) malloc(sizeof(int) * CHUNK_AMOUNT);
+	if(chunk_indices == NULL) {
+		fprintf(stderr, "Could not allocate chunk indices\n");
+		exit(1);
+	}
+	int chunk_amount = 0;
+	for(size_t i = 0; i < CHUNK_AMOUNT; i++) {
+		if(marked[i]) {
+			chunk_indices[chunk_amount++] = (int) i;
+		}
+	}
+	edit->first_vertex = remesh_chunks(chunk_indices, chunk_amount);
+	free(chunk_indices);
+	free(marked);
+
+	edit->blocks = list.indices;
+	edit->block_amount = list.amount;
+	edit->chunk_amount = (unsigned int) chunk_amount;
+	edit->seconds = current_time() - start;
+	end_phase(METRIC_PHASE_EDIT, start);
+	return true;
+}
+
+void free_edit(struct edit *edit) {
+	free(edit->blocks);
+	edit->blocks = NULL;
+	edit->block_amount = 0;
+}
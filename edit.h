@@ -0,0 +1,19 @@
+#ifndef _EDIT_H
+#define _EDIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// What a block edit changed
+struct edit {
+	size_t *blocks;	// The edited block and every block whose occlusion was recalculated, by index x + y * size_x + z * size_x * size_y
+	unsigned int block_amount;
+	unsigned int chunk_amount;	// Chunks meshed again
+	unsigned int first_vertex;	// Vertices from here on may have changed
+	double seconds;
+};
+
+bool edit_block(int x, int y, int z, unsigned int type, struct edit *edit);
+void free_edit(struct edit *edit);
+
+#endif /* !defined _EDIT_H */
@@ -0,0 +1,35 @@
+#include <stdbool.h>
+
+#include "frustum.h"
+
+// Functions
+
+// From the column-major clip matrix, projection * modelview
+void extract_frustum(struct frustum *frustum, const struct mat4 *clip_matrix) {
+	const float *clip = (const float *) clip_matrix;
+
+	// Every plane is the last row of the clip matrix plus or minus one of the others
+	for(int i = 0; i < 6; i++) {
+		int row = i / 2;
+		float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+		struct vec4 *plane = frustum->planes + i;
+		plane->x = clip[3] + sign * clip[row];
+		plane->y = clip[7] + sign * clip[4 + row];
+		plane->z = clip[11] + sign * clip[8 + row];
+		plane->w = clip[15] + sign * clip[12 + row];
+	}
+}
+
+bool box_in_frustum(const struct frustum *frustum, struct vec3 min, struct vec3 max) {
+	for(int i = 0; i < 6; i++) {
+		// The box is outside when even its corner furthest along the plane normal is behind the plane
+		const struct vec4 *plane = frustum->planes + i;
+		float x = (plane->x > 0.0f) ? max.x : min.x;
+		float y = (plane->y > 0.0f) ? max.y : min.y;
+		float z = (plane->z > 0.0f) ? max.z : min.z;
+		if(plane->x * x + plane->y * y + plane->z * z + plane->w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
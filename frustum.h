@@ -0,0 +1,16 @@
+#ifndef _FRUSTUM_H
+#define _FRUSTUM_H
+
+#include <stdbool.h>
+
+#include "world.h"
+
+// Left, right, bottom, top, near and far planes as ax + by + cz + d >= 0 for points inside
+struct frustum {
+	struct vec4 planes[6];
+};
+
+void extract_frustum(struct frustum *frustum, const struct mat4 *clip);
+bool box_in_frustum(const struct frustum *frustum, struct vec3 min, struct vec3 max);
+
+#endif /* !defined _FRUSTUM_H */
@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "heightmap.h"
+
+#define READ_BUFFER_SIZE 65536
+
+// On disk, the magic is followed by the other fields as little-endian 32-bit integers
+#define HEIGHT_MAP_HEADER_SIZE 24
+
+struct height_map_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t size_x;
+	uint32_t size_z;
+	uint32_t max_height;
+};
+
+// Reads the file in large blocks and hands it out one character at a time, tracking the position for errors
+struct reader {
+	FILE *file;
+	const char *filename;
+	size_t position;
+	size_t length;
+	int line;
+	int column;
+	unsigned char buffer[READ_BUFFER_SIZE];
+};
+
+// Util functions
+
+static inline int next_character(struct reader *reader) {
+	if(reader->position == reader->length) {
+		reader->length = fread(reader->buffer, 1, sizeof(reader->buffer), reader->file);
+		reader->position = 0;
+		if(reader->length == 0) {
+			return EOF;
+		}
+	}
+	int c = reader->buffer[reader->position++];
+	if(c == '\n') {
+		reader->line++;
+		reader->column = 0;
+	} else {
+		reader->column++;
+	}
+	return c;
+}
+
+static void put_uint32(unsigned char *bytes, uint32_t value) {
+	bytes[0] = (unsigned char) (value & 0xFF);
+	bytes[1] = (unsigned char) ((value >> 8) & 0xFF);
+	bytes[2] = (unsigned char) ((value >> 16) & 0xFF);
+	bytes[3] = (unsigned char) (value >> 24);
+}
+
+static uint32_t get_uint32(const unsigned char *bytes) {
+	return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+// Byte by byte, like the heights, so the file reads the same on any host
+static void encode_header(const struct height_map_header *header, unsigned char *bytes) {
+	memcpy(bytes, header->magic, sizeof(header->magic));
+	put_uint32(bytes + 8, header->version);
+	put_uint32(bytes + 12, header->size_x);
+	put_uint32(bytes + 16, header->size_z);
+	put_uint32(bytes + 20, header->max_height);
+}
+
+static void decode_header(const unsigned char *bytes, struct height_map_header *header) {
+	memcpy(header->magic, bytes, sizeof(header->magic));
+	header->version = get_uint32(bytes + 8);
+	header->size_x = get_uint32(bytes + 12);
+	header->size_z = get_uint32(bytes + 16);
+	header->max_height = get_uint32(bytes + 20);
+}
+
+// Prefix for an error at the character just read
+static void report_position(const struct reader *reader) {
+	fprintf(stderr, "%s:%d:%d: ", reader->filename, reader->line, reader->column);
+}
+
+static bool append_height(struct height_map_data *map, size_t *amount, size_t *capacity, int height) {
+	if(*amount == *capacity) {
+		size_t new_capacity = *capacity * 2;
+		int *heights = (int *) realloc(map->heights, sizeof(int) * new_capacity);
+		if(heights == NULL) {
+			fprintf(stderr, "Could not allocate %zu heights\n", new_capacity);
+			return false;
+		}
+		map->heights = heights;
+		*capacity = new_capacity;
+	}
+	map->heights[(*amount)++] = height;
+	if(height > map->max_height) {
+		map->max_height = height;
+	}
+	return true;
+}
+
+// One pass over the text; rows may end in \r\n, blank lines are skipped and the last newline is optional
+static bool parse_text(struct reader *reader, struct height_map_data *map) {
+	size_t amount = 0;
+	size_t capacity = 4096;
+	map->heights = (int *) malloc(sizeof(int) * capacity);
+	if(map->heights == NULL) {
+		fprintf(stderr, "Could not allocate %zu heights\n", capacity);
+		return false;
+	}
+
+	int row_cells = 0;
+	int c = next_character(reader);
+	while(c != EOF || row_cells > 0) {
+		if(c == '[') {
+			int height = 0;
+			int digits = 0;
+			while((c = next_character(reader)) >= '0' && c <= '9') {
+				height = height * 10 + (c - '0');
+				digits++;
+				if(height > HEIGHT_MAP_MAX_HEIGHT) {
+					report_position(reader);
+					fprintf(stderr, "height is larger than %d\n", HEIGHT_MAP_MAX_HEIGHT);
+					return false;
+				}
+			}
+			if(digits == 0 || c != ']') {
+				report_position(reader);
+				fprintf(stderr, "expected %s\n", (digits == 0) ? "a height" : "']'");
+				return false;
+			}
+			if(!append_height(map, &amount, &capacity, height)) {
+				return false;
+			}
+			row_cells++;
+			if(row_cells > HEIGHT_MAP_MAX_SIZE) {
+				report_position(reader);
+				fprintf(stderr, "row is wider than %d cells\n", HEIGHT_MAP_MAX_SIZE);
+				return false;
+			}
+			c = next_character(reader);
+		} else if(c == '\n' || c == '\r' || c == EOF) {
+			if(c == '\r' && (c = next_character(reader)) != '\n') {
+				report_position(reader);
+				fprintf(stderr, "expected a newline after carriage return\n");
+				return false;
+			}
+			if(row_cells > 0) {
+				// The first row decides the width
+				if(map->size_z == 0) {
+					map->size_x = row_cells;
+				} else if(row_cells != map->size_x) {
+					fprintf(stderr, "%s:%d: row has %d cells instead of %d\n", reader->filename, (c == EOF) ? reader->line : reader->line - 1, row_cells, map->size_x);
+					return false;
+				}
+				map->size_z++;
+				if(map->size_z > HEIGHT_MAP_MAX_SIZE) {
+					fprintf(stderr, "%s: more than %d rows\n", reader->filename, HEIGHT_MAP_MAX_SIZE);
+					return false;
+				}
+				row_cells = 0;
+			}
+			if(c != EOF) {
+				c = next_character(reader);
+			}
+		} else {
+			report_position(reader);
+			fprintf(stderr, "expected '[' or a newline\n");
+			return false;
+		}
+	}
+
+	if(map->size_z == 0) {
+		fprintf(stderr, "%s: height map is empty\n", reader->filename);
+		return false;
+	}
+	return true;
+}
+
+static bool read_text_height_map(FILE *file, const char *filename, struct height_map_data *map) {
+	struct reader *reader = (struct reader *) malloc(sizeof(struct reader));
+	if(reader == NULL) {
+		fprintf(stderr, "Could not allocate height map reader\n");
+		return false;
+	}
+	reader->file = file;
+	reader->filename = filename;
+	reader->position = 0;
+	reader->length = 0;
+	reader->line = 1;
+	reader->column = 0;
+
+	bool parsed = parse_text(reader, map);
+	free(reader);
+	return parsed;
+}
+
+static bool read_binary_height_map(int fd, size_t file_size, const char *filename, struct height_map_data *map) {
+	unsigned char header_bytes[HEIGHT_MAP_HEADER_SIZE];
+	if(file_size < sizeof(header_bytes) || pread(fd, header_bytes, sizeof(header_bytes), 0) != (ssize_t) sizeof(header_bytes)) {
+		fprintf(stderr, "%s: truncated header\n", filename);
+		return false;
+	}
+	struct height_map_header header;
+	decode_header(header_bytes, &header);
+	if(header.version != HEIGHT_MAP_VERSION) {
+		fprintf(stderr, "%s: unsupported version %u\n", filename, header.version);
+		return false;
+	}
+	if(header.size_x == 0 || header.size_z == 0 || header.size_x > HEIGHT_MAP_MAX_SIZE || header.size_z > HEIGHT_MAP_MAX_SIZE) {
+		fprintf(stderr, "%s: invalid size %ux%u\n", filename, header.size_x, header.size_z);
+		return false;
+	}
+	size_t amount = (size_t) header.size_x * (size_t) header.size_z;
+	if(file_size != HEIGHT_MAP_HEADER_SIZE + amount * 2) {
+		fprintf(stderr, "%s: expected %zu bytes for a %ux%u map, found %zu\n", filename, HEIGHT_MAP_HEADER_SIZE + amount * 2, header.size_x, header.size_z, file_size);
+		return false;
+	}
+
+	void *data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(data == MAP_FAILED) {
+		fprintf(stderr, "%s: could not map file\n", filename);
+		return false;
+	}
+	map->heights = (int *) malloc(sizeof(int) * amount);
+	if(map->heights == NULL) {
+		fprintf(stderr, "Could not allocate %zu heights\n", amount);
+		munmap(data, file_size);
+		return false;
+	}
+
+	// Byte by byte, so the file reads the same on any host
+	const unsigned char *bytes = (const unsigned char *) data + HEIGHT_MAP_HEADER_SIZE;
+	int max_height = 0;
+	for(size_t i = 0; i < amount; i++) {
+		int height = bytes[i * 2] | bytes[i * 2 + 1] << 8;
+		map->heights[i] = height;
+		if(height > max_height) {
+			max_height = height;
+		}
+	}
+	munmap(data, file_size);
+
+	map->size_x = (int) header.size_x;
+	map->size_z = (int) header.size_z;
+	map->max_height = max_height;
+	return true;
+}
+
+static bool write_text_height_map(FILE *file, const struct height_map_data *map) {
+	for(int z = 0; z < map->size_z; z++) {
+		const int *row = map->heights + (size_t) z * (size_t) map->size_x;
+		for(int x = 0; x < map->size_x; x++) {
+			if(fprintf(file, "[%d]", row[x]) < 0) {
+				return false;
+			}
+		}
+		if(fputc('\n', file) == EOF) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool write_binary_height_map(FILE *file, const struct height_map_data *map) {
+	struct height_map_header header;
+	memcpy(header.magic, HEIGHT_MAP_MAGIC, sizeof(header.magic));
+	header.version = HEIGHT_MAP_VERSION;
+	header.size_x = (uint32_t) map->size_x;
+	header.size_z = (uint32_t) map->size_z;
+	header.max_height = (uint32_t) map->max_height;
+	unsigned char header_bytes[HEIGHT_MAP_HEADER_SIZE];
+	encode_header(&header, header_bytes);
+	if(fwrite(header_bytes, 1, sizeof(header_bytes), file) != sizeof(header_bytes)) {
+		return false;
+	}
+
+	// One row at a time
+	size_t row_size = (size_t) map->size_x * 2;
+	unsigned char *row = (unsigned char *) malloc(row_size);
+	if(row == NULL) {
+		fprintf(stderr, "Could not allocate height map row\n");
+		return false;
+	}
+	bool written = true;
+	for(int z = 0; z < map->size_z && written; z++) {
+		const int *heights = map->heights + (size_t) z * (size_t) map->size_x;
+		for(int x = 0; x < map->size_x; x++) {
+			row[x * 2] = (unsigned char) (heights[x] & 0xFF);
+			row[x * 2 + 1] = (unsigned char) (heights[x] >> 8);
+		}
+		written = fwrite(row, 1, row_size, file) == row_size;
+	}
+	free(row);
+	return written;
+}
+
+// Functions
+
+// Reads either format, telling them apart by the magic; errors are reported with the file position
+bool read_height_map(const char *filename, struct height_map_data *map) {
+	map->size_x = 0;
+	map->size_z = 0;
+	map->max_height = 0;
+	map->heights = NULL;
+
+	FILE *file = fopen(filename, "rb");
+	if(file == NULL) {
+		fprintf(stderr, "Unable to open %s for reading\n", filename);
+		return false;
+	}
+
+	char magic[sizeof(HEIGHT_MAP_MAGIC) - 1];
+	bool binary = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, HEIGHT_MAP_MAGIC, sizeof(magic)) == 0;
+	bool loaded;
+	if(binary) {
+		struct stat status;
+		loaded = fstat(fileno(file), &status) == 0 && read_binary_height_map(fileno(file), (size_t) status.st_size, filename, map);
+	} else {
+		rewind(file);
+		loaded = read_text_height_map(file, filename, map);
+	}
+	fclose(file);
+
+	if(!loaded) {
+		free_height_map_data(map);
+	}
+	return loaded;
+}
+
+bool write_height_map(const char *filename, const struct height_map_data *map, enum height_map_format format) {
+	if(map->max_height > HEIGHT_MAP_MAX_HEIGHT) {
+		fprintf(stderr, "Heights above %d do not fit in %s\n", HEIGHT_MAP_MAX_HEIGHT, filename);
+		return false;
+	}
+
+	FILE *file = fopen(filename, "wb");
+	if(file == NULL) {
+		fprintf(stderr, "Unable to open %s for writing\n", filename);
+		return false;
+	}
+	bool written = (format == HEIGHT_MAP_BINARY) ? write_binary_height_map(file, map) : write_text_height_map(file, map);
+	if(fclose(file) != 0) {
+		written = false;
+	}
+	if(!written) {
+		fprintf(stderr, "Could not write %s\n", filename);
+	}
+	return written;
+}
+
+void free_height_map_data(struct height_map_data *map) {
+	free(map->heights);
+	map->heights = NULL;
+}
@@ -0,0 +1,30 @@
+#ifndef _HEIGHTMAP_H
+#define _HEIGHTMAP_H
+
+#include <stdbool.h>
+
+// Binary height maps are the magic, then version, size_x, size_z and max_height as little-endian 32-bit integers, then
+// size_x * size_z little-endian 16-bit heights, one row of x per z
+#define HEIGHT_MAP_MAGIC "STONEMAP"
+#define HEIGHT_MAP_VERSION 1
+#define HEIGHT_MAP_MAX_HEIGHT 65535
+#define HEIGHT_MAP_MAX_SIZE 65536
+
+// Text height maps have one line of [height] cells per z coordinate
+enum height_map_format {
+	HEIGHT_MAP_TEXT,
+	HEIGHT_MAP_BINARY
+};
+
+struct height_map_data {
+	int size_x;
+	int size_z;
+	int max_height;
+	int *heights;	// Row-major, x varying fastest
+};
+
+bool read_height_map(const char *filename, struct height_map_data *map);
+bool write_height_map(const char *filename, const struct height_map_data *map, enum height_map_format format);
+void free_height_map_data(struct height_map_data *map);
+
+#endif /* !defined _HEIGHTMAP_H */
@@ -1,16 +1,23 @@
 #include <stdlib.h>
 #include <GL/glew.h>
+#ifdef __APPLE__
 #include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "main.h"
 #include "world.h"
+#include "metrics.h"
+#include "util.h"
 
 // Globals
 
 int previous_frame;
+double previous_frame_time;
 
 int fps_counter;
 int fps_last_update;
@@ -18,18 +25,11 @@ int fps_last_update;
 // Functions
 
 void init(int argc, char **argv) {
-	// Seed random number generator
-	srandomdev();
-
 	// Initialize timers
 	previous_frame = glutGet(GLUT_ELAPSED_TIME);
 	fps_counter = 0;
 	fps_last_update = 0;
 
-	// Initialize projection matrix
-	glMatrixMode(GL_PROJECTION);
-	gluPerspective(60.0f, (1024.0 / 768.0), 0.1f, 1024.0f);
-
 	// Depth test
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
@@ -39,6 +39,7 @@ void init(int argc, char **argv) {
 
 	// Initialize world
 	world_init(argc, argv);
+	previous_frame_time = current_time();
 }
 
 void idle() {
@@ -47,12 +48,17 @@ void idle() {
 	int delta = elapsed - previous_frame;
 	previous_frame = elapsed;
 
+	// GLUT's clock only has milliseconds
+	double now = current_time();
+	record_duration(METRIC_HISTOGRAM_FRAME, now - previous_frame_time);
+	previous_frame_time = now;
+
 	// Calculate FPS
 	fps_counter++;
 	if((elapsed - fps_last_update) > 1000) {
 		// Update window title with current FPS
 		char *title;
-		asprintf(&title, "Stone | %d FPS", fps_counter);
+		asprintf(&title, "Stone | %d FPS | %u chunks, %u vertices culled | %u vertices back-facing", fps_counter, culled_chunks, culled_vertices, back_facing_vertices);
 		glutSetWindowTitle(title);
 		free(title);
 
@@ -66,10 +72,16 @@ void idle() {
 	glutPostRedisplay();
 }
 
+void reshape(int width, int height) {
+	world_reshape(width, height);
+}
+
 void display() {
+	double start = current_time();
 	world_display();
 
 	glutSwapBuffers();
+	record_duration(METRIC_HISTOGRAM_DISPLAY, current_time() - start);
 }
 
 void keyboard(unsigned char key, int x, int y) {
@@ -89,11 +101,12 @@ int main(int argc, char **argv) {
 	glutInit(&argc, argv);
 
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
-	glutInitWindowSize(1024, 768);
+	glutInitWindowSize(DEFAULT_VIEWPORT_WIDTH, DEFAULT_VIEWPORT_HEIGHT);
 	glutCreateWindow("Stone");
 
 	glutIdleFunc(idle);
 	glutDisplayFunc(display);
+	glutReshapeFunc(reshape);
 	glutKeyboardFunc(keyboard);
 	glutMouseFunc(mouse);
 
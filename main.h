@@ -3,6 +3,7 @@
 
 static void init(int argc, char **argv);
 static void idle(void);
+static void reshape(int width, int height);
 static void display(void);
 static void keyboard(unsigned char key, int x, int y);
 static void mouse(int button, int state, int x, int y);
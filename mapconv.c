@@ -0,0 +1,51 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "mapconv.h"
+#include "heightmap.h"
+#include "util.h"
+
+// Functions
+
+void usage(const char *program) {
+	fprintf(stderr, "Usage: %s [-t] input output\n", program);
+	fprintf(stderr, "Converts a height map in either format to binary, or to text with -t\n");
+}
+
+int main(int argc, char **argv) {
+	enum height_map_format format = HEIGHT_MAP_BINARY;
+	int c;
+	while((c = getopt(argc, argv, "t")) != -1) {
+		switch(c) {
+			case 't':
+				format = HEIGHT_MAP_TEXT;
+				break;
+			case '?':
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if(argc - optind != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+	const char *input = argv[optind];
+	const char *output = argv[optind + 1];
+
+	double start = current_time();
+	struct height_map_data map;
+	if(!read_height_map(input, &map)) {
+		return 1;
+	}
+	double loaded = current_time();
+	if(!write_height_map(output, &map, format)) {
+		free_height_map_data(&map);
+		return 1;
+	}
+	fprintf(stderr, "Converted %dx%d height map (highest %d) in %.3f ms read, %.3f ms written\n", map.size_x, map.size_z, map.max_height, (loaded - start) * 1000.0, (current_time() - loaded) * 1000.0);
+
+	free_height_map_data(&map);
+	return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef _MAPCONV_H
+#define _MAPCONV_H
+
+static void usage(const char *program);
+
+#endif /* !defined _MAPCONV_H */
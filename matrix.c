@@ -0,0 +1,99 @@
+#include <math.h>
+
+#include "matrix.h"
+
+// Util functions
+
+// sum + vector * factor, one lane per component, so the compiler can keep a column in one register
+static inline struct vec4 add_scaled(struct vec4 sum, struct vec4 vector, float factor) {
+	sum.x += vector.x * factor;
+	sum.y += vector.y * factor;
+	sum.z += vector.z * factor;
+	sum.w += vector.w * factor;
+	return sum;
+}
+
+// a * column: the columns of a weighted by the components of column
+static inline struct vec4 transform(const struct mat4 *a, struct vec4 column) {
+	struct vec4 result = {0.0f, 0.0f, 0.0f, 0.0f};
+	result = add_scaled(result, a->x, column.x);
+	result = add_scaled(result, a->y, column.y);
+	result = add_scaled(result, a->z, column.z);
+	result = add_scaled(result, a->w, column.w);
+	return result;
+}
+
+static inline struct vec3 subtract(struct vec3 a, struct vec3 b) {
+	struct vec3 result = {a.x - b.x, a.y - b.y, a.z - b.z};
+	return result;
+}
+
+static inline struct vec3 cross(struct vec3 a, struct vec3 b) {
+	struct vec3 result = {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	return result;
+}
+
+static inline float dot(struct vec3 a, struct vec3 b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline struct vec3 normalize(struct vec3 a) {
+	float length = sqrtf(dot(a, a));
+	struct vec3 result = {a.x / length, a.y / length, a.z / length};
+	return result;
+}
+
+// Functions
+
+void identity_matrix(struct mat4 *matrix) {
+	struct mat4 identity = {
+		{1.0f, 0.0f, 0.0f, 0.0f},
+		{0.0f, 1.0f, 0.0f, 0.0f},
+		{0.0f, 0.0f, 1.0f, 0.0f},
+		{0.0f, 0.0f, 0.0f, 1.0f}
+	};
+	*matrix = identity;
+}
+
+// result = a * b; result may be a or b
+void multiply_matrices(struct mat4 *result, const struct mat4 *a, const struct mat4 *b) {
+	struct mat4 product;
+	product.x = transform(a, b->x);
+	product.y = transform(a, b->y);
+	product.z = transform(a, b->z);
+	product.w = transform(a, b->w);
+	*result = product;
+}
+
+// matrix = matrix * translation, like glTranslatef
+void translate_matrix(struct mat4 *matrix, float x, float y, float z) {
+	struct vec4 offset = {x, y, z, 1.0f};
+	matrix->w = transform(matrix, offset);
+}
+
+// Same as gluPerspective, with the vertical field of view in degrees
+void perspective_matrix(struct mat4 *matrix, float fov_y, float aspect, float z_near, float z_far) {
+	float f = 1.0f / tanf(fov_y * (float) M_PI / 360.0f);
+	float depth = z_near - z_far;
+	struct mat4 perspective = {
+		{f / aspect, 0.0f, 0.0f, 0.0f},
+		{0.0f, f, 0.0f, 0.0f},
+		{0.0f, 0.0f, (z_far + z_near) / depth, -1.0f},
+		{0.0f, 0.0f, 2.0f * z_far * z_near / depth, 0.0f}
+	};
+	*matrix = perspective;
+}
+
+// Same as gluLookAt
+void look_at_matrix(struct mat4 *matrix, struct vec3 eye, struct vec3 target, struct vec3 up) {
+	struct vec3 forward = normalize(subtract(target, eye));
+	struct vec3 side = normalize(cross(forward, up));
+	struct vec3 camera_up = cross(side, forward);
+	struct mat4 look_at = {
+		{side.x, camera_up.x, -forward.x, 0.0f},
+		{side.y, camera_up.y, -forward.y, 0.0f},
+		{side.z, camera_up.z, -forward.z, 0.0f},
+		{-dot(side, eye), -dot(camera_up, eye), dot(forward, eye), 1.0f}
+	};
+	*matrix = look_at;
+}
@@ -0,0 +1,14 @@
+#ifndef _MATRIX_H
+#define _MATRIX_H
+
+#include "world.h"
+
+// Matrices are column-major like OpenGL's: x, y, z and w are the columns, so a matrix uploads as it is
+
+void identity_matrix(struct mat4 *matrix);
+void multiply_matrices(struct mat4 *result, const struct mat4 *a, const struct mat4 *b);
+void translate_matrix(struct mat4 *matrix, float x, float y, float z);
+void perspective_matrix(struct mat4 *matrix, float fov_y, float aspect, float z_near, float z_far);
+void look_at_matrix(struct mat4 *matrix, struct vec3 eye, struct vec3 target, struct vec3 up);
+
+#endif /* !defined _MATRIX_H */
@@ -0,0 +1,532 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "terrain.h"
+#include "occupancy.h"
+#include "thread.h"
+#include "metrics.h"
+#include "mesh.h"
+
+// Globals
+
+struct vertex *vertex_buffer_data = NULL;
+unsigned int vertex_amount = 0;
+unsigned int *face_vertex_offsets = NULL;
+struct mesh_bounds *chunk_bounds = NULL;
+
+// The flags the vertex buffer was filled with, for remeshing
+static int vertex_buffer_flags = 0;
+
+// Remeshing writes a new vertex buffer into the one it replaced last time, unless that was borrowed
+static unsigned int vertex_capacity = 0;
+static bool vertex_buffer_borrowed = false;
+static struct vertex *spare_vertex_buffer_data = NULL;
+static unsigned int spare_vertex_capacity = 0;
+
+unsigned char *attribute_volumes[ATTRIBUTE_VOLUME_AMOUNT] = {NULL, NULL, NULL};
+
+// Per face orientation: the axis it faces along, and its outward normal
+static const int face_axes[FACE_AMOUNT] = {0, 0, 1, 1, 2, 2};
+static const int face_normals[FACE_AMOUNT][3] = {
+	{1, 0, 0}, {-1, 0, 0},
+	{0, 1, 0}, {0, -1, 0},
+	{0, 0, 1}, {0, 0, -1}
+};
+
+// Quad corners per face orientation, as (far end along u?, far end along v?) with u/v the remaining axes in order
+static const int face_corners[FACE_AMOUNT][4][2] = {
+	{{0, 1}, {0, 0}, {1, 0}, {1, 1}},
+	{{0, 0}, {0, 1}, {1, 1}, {1, 0}},
+	{{0, 0}, {1, 0}, {1, 1}, {0, 1}},
+	{{1, 1}, {1, 0}, {0, 0}, {0, 1}},
+	{{0, 0}, {0, 1}, {1, 1}, {1, 0}},
+	{{1, 0}, {0, 0}, {0, 1}, {1, 1}}
+};
+
+// Where the faces of one chunk go; without vertices they are only counted
+struct mesh_output {
+	struct vertex *vertices;
+	unsigned int amount;
+};
+
+struct mesh_job {
+	int flags;
+	bool writing;
+	const int *chunk_indices;	// Chunks to mesh, or NULL for all of them
+	unsigned int *offsets;	// Laid out like face_vertex_offsets
+	struct vertex *vertices;
+};
+
+// Util functions
+
+static void dump_vertex(struct vertex *vert) {
+	fprintf(stderr, "Dumping vertex:\n");
+	fprintf(stderr, "\tposition = (%d, %d, %d)\n", vert->x, vert->y, vert->z);
+	fprintf(stderr, "\tface = %d\n", vert->face);
+	fprintf(stderr, "\tshade = (%u, %u, %u)\n", vert->shade[0], vert->shade[1], vert->shade[2]);
+	fprintf(stderr, "\tocclusion = %u\n", vert->occlusion);
+}
+
+static void create_vertex(struct mesh_output *output, int px, int py, int pz, int face, unsigned int shade, unsigned char occlusion) {
+	if(output->vertices != NULL) {
+		struct vertex *new_vertex = output->vertices + output->amount;
+
+		new_vertex->x = (short) px;
+		new_vertex->y = (short) py;
+		new_vertex->z = (short) pz;
+		new_vertex->face = (short) face;
+		new_vertex->shade[0] = (unsigned char) (shade & (PALETTE_LEVELS - 1));
+		new_vertex->shade[1] = (unsigned char) ((shade >> PALETTE_BITS) & (PALETTE_LEVELS - 1));
+		new_vertex->shade[2] = (unsigned char) ((shade >> (PALETTE_BITS * 2)) & (PALETTE_LEVELS - 1));
+		new_vertex->occlusion = occlusion;
+	}
+
+	output->amount++;
+}
+
+// Occlusion of a face, looked up in the AIR block it faces
+static unsigned char get_face_occlusion(int face, int x, int y, int z) {
+	if(!is_inside(x, y, z)) {
+		return 0;
+	}
+	struct block air = get_block(x, y, z);
+	if(air.data == 0) {
+		return 0;
+	}
+	struct occlusion *occlusion = occlusion_slots + air.data;
+	switch(face) {
+		case FACE_POSITIVE_X:
+			return occlusion->left;
+		case FACE_NEGATIVE_X:
+			return occlusion->right;
+		case FACE_POSITIVE_Y:
+			return occlusion->down;
+		case FACE_NEGATIVE_Y:
+			return occlusion->up;
+		case FACE_POSITIVE_Z:
+			return occlusion->back;
+		default:
+			return occlusion->front;
+	}
+}
+
+static void create_quad(struct mesh_output *output, int face, int position[3], int width, int height, unsigned int shade, unsigned char occlusion) {
+	int axis = face_axes[face];
+	int u = (axis == 0) ? 1 : 0;
+	int v = (axis == 2) ? 1 : 2;
+	const int *normal = face_normals[face];
+
+	for(int i = 0; i < 4; i++) {
+		int corner[3];
+		corner[axis] = position[axis] + ((normal[axis] > 0) ? 1 : 0);
+		corner[u] = position[u] + (face_corners[face][i][0] ? width : 0);
+		corner[v] = position[v] + (face_corners[face][i][1] ? height : 0);
+		create_vertex(output, corner[0], corner[1], corner[2], face, shade, occlusion);
+	}
+}
+
+// Emit the faces of one orientation in one chunk, slice by slice; greedy meshing merges equal neighbouring faces
+static void mesh_chunk_faces(struct mesh_output *output, int cx, int cy, int cz, int face, int flags) {
+	bool greedy = (flags & MESH_GREEDY) != 0;
+	bool textured = (flags & MESH_TEXTURED) != 0;
+
+	// Only merging looks at the attributes of faces that are merely counted
+	bool attributes = !textured && (greedy || output->vertices != NULL);
+
+	int axis = face_axes[face];
+	int u = (axis == 0) ? 1 : 0;
+	int v = (axis == 2) ? 1 : 2;
+	const int *normal = face_normals[face];
+
+	int origin[3] = {cx * CHUNK_SIZE, cy * CHUNK_SIZE, cz * CHUNK_SIZE};
+	int size[3] = {world_size_x, world_size_y, world_size_z};
+	int end[3];
+	for(int i = 0; i < 3; i++) {
+		end[i] = (origin[i] + CHUNK_SIZE < size[i]) ? origin[i] + CHUNK_SIZE : size[i];
+	}
+	int width = end[u] - origin[u];
+	int height = end[v] - origin[v];
+
+	// Inside a solid chunk faces only show on the slice at its border
+	int first = origin[axis];
+	int last = end[axis];
+	struct chunk *chunk = get_chunk(cx, cy, cz);
+	if(chunk->blocks == NULL) {
+		if(normal[axis] > 0) {
+			first = last - 1;
+		} else {
+			last = first + 1;
+		}
+	}
+
+	// Faces in the current slice, keyed by their attributes (-1 = no face)
+	long mask[CHUNK_SIZE][CHUNK_SIZE];
+
+	for(int d = first; d < last; d++) {
+		bool any = false;
+		for(int j = 0; j < height; j++) {
+			for(int i = 0; i < width; i++) {
+				int block[3];
+				block[axis] = d;
+				block[u] = origin[u] + i;
+				block[v] = origin[v] + j;
+				int air[3] = {block[0] + normal[0], block[1] + normal[1], block[2] + normal[2]};
+
+				mask[j][i] = -1;
+				if(!is_solid(block[0], block[1], block[2]) || is_solid_inside(air[0], air[1], air[2])) {
+					continue;
+				}
+				if(!attributes) {
+					mask[j][i] = 0;
+				} else {
+					unsigned int shade = get_block_shade(block[0], block[1], block[2]);
+					unsigned char occlusion = get_face_occlusion(face, air[0], air[1], air[2]);
+					mask[j][i] = (long) shade | (long) occlusion << 16;
+				}
+				any = true;
+			}
+		}
+		if(!any) {
+			continue;
+		}
+
+		for(int j = 0; j < height; j++) {
+			for(int i = 0; i < width; i++) {
+				long key = mask[j][i];
+				if(key < 0) {
+					continue;
+				}
+
+				// Grow the quad along u, then along v for as long as every face in the next row matches
+				int w = 1;
+				int h = 1;
+				if(greedy) {
+					while(i + w < width && mask[j][i + w] == key) {
+						w++;
+					}
+					for(bool grow = true; grow && j + h < height; ) {
+						for(int k = 0; k < w; k++) {
+							if(mask[j + h][i + k] != key) {
+								grow = false;
+								break;
+							}
+						}
+						if(grow) {
+							h++;
+						}
+					}
+				}
+				for(int l = 0; l < h; l++) {
+					for(int k = 0; k < w; k++) {
+						mask[j + l][i + k] = -1;
+					}
+				}
+
+				int position[3];
+				position[axis] = d;
+				position[u] = origin[u] + i;
+				position[v] = origin[v] + j;
+				create_quad(output, face, position, w, h, (unsigned int) (key & 0xFFFF), (unsigned char) (key >> 16));
+			}
+		}
+	}
+}
+
+// Vertex buffer
+
+// Faces belong to the chunk of the solid block they're on
+static void mesh_chunk(int job_index, void *data) {
+	struct mesh_job *job = (struct mesh_job *) data;
+	int index = (job->chunk_indices != NULL) ? job->chunk_indices[job_index] : job_index;
+	int cx = index % chunks_x;
+	int cy = (index / chunks_x) % chunks_y;
+	int cz = index / (chunks_x * chunks_y);
+
+	unsigned int *offsets = job->offsets + (size_t) index * FACE_AMOUNT;
+	struct mesh_output output;
+	output.vertices = job->writing ? job->vertices + offsets[0] : NULL;
+	output.amount = 0;
+
+	// Faces of one orientation form a single range
+	struct chunk *chunk = chunks + index;
+	bool empty = chunk->blocks == NULL && chunk->uniform.type == TYPE_AIR;
+	for(int face = 0; face < FACE_AMOUNT; face++) {
+		unsigned int start = output.amount;
+		if(!empty) {
+			mesh_chunk_faces(&output, cx, cy, cz, face, job->flags);
+		}
+
+		// The first pass leaves the count where the prefix sum turns it into the next range's offset
+		if(!job->writing) {
+			offsets[face + 1] = output.amount - start;
+		}
+	}
+	if(!job->writing) {
+		return;
+	}
+
+	// Empty chunks keep an empty box at the origin
+	struct mesh_bounds *bounds = chunk_bounds + index;
+	struct vertex *first = output.vertices;
+	bounds->min.x = bounds->max.x = (output.amount > 0) ? first->x : 0.0f;
+	bounds->min.y = bounds->max.y = (output.amount > 0) ? first->y : 0.0f;
+	bounds->min.z = bounds->max.z = (output.amount > 0) ? first->z : 0.0f;
+	for(unsigned int i = 1; i < output.amount; i++) {
+		struct vertex *vert = output.vertices + i;
+		bounds->min.x = fminf(bounds->min.x, vert->x);
+		bounds->min.y = fminf(bounds->min.y, vert->y);
+		bounds->min.z = fminf(bounds->min.z, vert->z);
+		bounds->max.x = fmaxf(bounds->max.x, vert->x);
+		bounds->max.y = fmaxf(bounds->max.y, vert->y);
+		bounds->max.z = fmaxf(bounds->max.z, vert->z);
+	}
+}
+
+// Turn the vertex counts following offsets[0] into offsets; returns the total
+static unsigned int sum_offsets(unsigned int *offsets, size_t range_amount) {
+	unsigned long long total = 0;
+	offsets[0] = 0;
+	for(size_t i = 0; i < range_amount; i++) {
+		total += offsets[i + 1];
+		if(total > UINT_MAX) {
+			fprintf(stderr, "Too many vertices (%llu)\n", total);
+			exit(1);
+		}
+		offsets[i + 1] = (unsigned int) total;
+	}
+	return (unsigned int) total;
+}
+
+static unsigned int *allocate_offsets(size_t range_amount) {
+	unsigned int *offsets = (unsigned int *) malloc(sizeof(unsigned int) * (range_amount + 1));
+	if(offsets == NULL) {
+		fprintf(stderr, "Could not allocate %zu vertex offsets\n", range_amount);
+		exit(1);
+	}
+	return offsets;
+}
+
+static struct vertex *allocate_vertices(unsigned int amount) {
+	struct vertex *vertices = (struct vertex *) malloc(sizeof(struct vertex) * amount);
+	if(vertices == NULL && amount > 0) {
+		fprintf(stderr, "Could not allocate enough memory for %u vertices\n", amount);
+		exit(1);
+	}
+	return vertices;
+}
+
+void fill_vertex_buffer(int flags) {
+	double start = begin_phase();
+	free_vertex_buffer();
+	vertex_buffer_flags = flags;
+
+	size_t chunk_amount = CHUNK_AMOUNT;
+	size_t range_amount = chunk_amount * FACE_AMOUNT;
+	face_vertex_offsets = allocate_offsets(range_amount);
+	chunk_bounds = (struct mesh_bounds *) malloc(sizeof(struct mesh_bounds) * chunk_amount);
+	if(chunk_bounds == NULL) {
+		fprintf(stderr, "Could not allocate bounds for %zu chunks\n", chunk_amount);
+		exit(1);
+	}
+
+	// Count the vertices of every chunk and face orientation
+	struct mesh_job job;
+	job.flags = flags;
+	job.writing = false;
+	job.chunk_indices = NULL;
+	job.offsets = face_vertex_offsets;
+	job.vertices = NULL;
+	parallel_for((int) chunk_amount, mesh_chunk, &job);
+
+	// Give every range its own part of one exactly sized buffer
+	vertex_amount = sum_offsets(face_vertex_offsets, range_amount);
+	vertex_capacity = vertex_amount;
+	vertex_buffer_data = allocate_vertices(vertex_amount);
+
+	// Write every chunk into its range
+	job.writing = true;
+	job.vertices = vertex_buffer_data;
+	parallel_for((int) chunk_amount, mesh_chunk, &job);
+	count_metric(METRIC_COUNTER_VERTICES_EMITTED, vertex_amount);
+	end_phase(METRIC_PHASE_VERTEX_BUFFER, start);
+}
+
+// Mesh the listed chunks (in ascending order) again, keeping the others; returns the first vertex that changed
+unsigned int remesh_chunks(const int *chunk_indices, int amount) {
+	if(amount == 0) {
+		return vertex_amount;
+	}
+
+	size_t chunk_amount = CHUNK_AMOUNT;
+	size_t range_amount = chunk_amount * FACE_AMOUNT;
+	unsigned int *offsets = allocate_offsets(range_amount);
+
+	// Count the listed chunks again and keep the counts of the others
+	for(size_t i = 0; i < range_amount; i++) {
+		offsets[i + 1] = face_vertex_offsets[i + 1] - face_vertex_offsets[i];
+	}
+	struct mesh_job job;
+	job.flags = vertex_buffer_flags;
+	job.writing = false;
+	job.chunk_indices = chunk_indices;
+	job.offsets = offsets;
+	job.vertices = NULL;
+	parallel_for(amount, mesh_chunk, &job);
+
+	unsigned int total = sum_offsets(offsets, range_amount);
+	if(total > spare_vertex_capacity) {
+		free(spare_vertex_buffer_data);
+		spare_vertex_capacity = total + total / 8;
+		spare_vertex_buffer_data = allocate_vertices(spare_vertex_capacity);
+	}
+	struct vertex *vertices = spare_vertex_buffer_data;
+
+	// Copy the runs of chunks in between the listed ones
+	size_t next = 0;
+	unsigned int copied = 0;
+	for(int i = 0; i <= amount; i++) {
+		size_t end = (i < amount) ? (size_t) chunk_indices[i] : chunk_amount;
+		unsigned int from = face_vertex_offsets[next * FACE_AMOUNT];
+		unsigned int length = face_vertex_offsets[end * FACE_AMOUNT] - from;
+		memcpy(vertices + offsets[next * FACE_AMOUNT], vertex_buffer_data + from, sizeof(struct vertex) * length);
+		copied += length;
+		next = end + 1;
+	}
+
+	job.writing = true;
+	job.vertices = vertices;
+	parallel_for(amount, mesh_chunk, &job);
+	count_metric(METRIC_COUNTER_VERTICES_EMITTED, total - copied);
+
+	unsigned int capacity = spare_vertex_capacity;
+	spare_vertex_buffer_data = vertex_buffer_borrowed ? NULL : vertex_buffer_data;
+	spare_vertex_capacity = vertex_buffer_borrowed ? 0 : vertex_capacity;
+	vertex_buffer_borrowed = false;
+	vertex_buffer_data = vertices;
+	vertex_capacity = capacity;
+	vertex_amount = total;
+	free(face_vertex_offsets);
+	face_vertex_offsets = offsets;
+
+	return offsets[(size_t) chunk_indices[0] * FACE_AMOUNT];
+}
+
+// Two triangles for every quad of four vertices, shared by all meshes
+unsigned int *create_quad_indices(unsigned int quad_amount) {
+	unsigned int *indices = (unsigned int *) malloc(sizeof(unsigned int) * INDICES_PER_QUAD * quad_amount);
+	if(indices == NULL) {
+		fprintf(stderr, "Could not allocate indices for %u quads\n", quad_amount);
+		exit(1);
+	}
+	for(unsigned int i = 0; i < quad_amount; i++) {
+		unsigned int *quad = indices + INDICES_PER_QUAD * i;
+		quad[0] = 4 * i;
+		quad[1] = 4 * i + 1;
+		quad[2] = 4 * i + 2;
+		quad[3] = 4 * i;
+		quad[4] = 4 * i + 2;
+		quad[5] = 4 * i + 3;
+	}
+	return indices;
+}
+
+// Use vertices that live elsewhere, such as in a mapped file; the first remesh replaces them with a copy
+void use_vertex_buffer(struct vertex *vertices, unsigned int amount, const unsigned int *offsets, const struct mesh_bounds *bounds, int flags) {
+	free_vertex_buffer();
+	vertex_buffer_flags = flags;
+
+	size_t chunk_amount = CHUNK_AMOUNT;
+	size_t range_amount = chunk_amount * FACE_AMOUNT;
+	face_vertex_offsets = allocate_offsets(range_amount);
+	memcpy(face_vertex_offsets, offsets, sizeof(unsigned int) * (range_amount + 1));
+	chunk_bounds = (struct mesh_bounds *) malloc(sizeof(struct mesh_bounds) * chunk_amount);
+	if(chunk_bounds == NULL) {
+		fprintf(stderr, "Could not allocate bounds for %zu chunks\n", chunk_amount);
+		exit(1);
+	}
+	memcpy(chunk_bounds, bounds, sizeof(struct mesh_bounds) * chunk_amount);
+
+	vertex_buffer_data = vertices;
+	vertex_amount = amount;
+	vertex_capacity = amount;
+	vertex_buffer_borrowed = true;
+}
+
+void free_vertex_buffer() {
+	if(!vertex_buffer_borrowed) {
+		free(vertex_buffer_data);
+	}
+	vertex_buffer_borrowed = false;
+	vertex_buffer_data = NULL;
+	vertex_amount = 0;
+	vertex_capacity = 0;
+	free(spare_vertex_buffer_data);
+	spare_vertex_buffer_data = NULL;
+	spare_vertex_capacity = 0;
+	free(face_vertex_offsets);
+	face_vertex_offsets = NULL;
+	free(chunk_bounds);
+	chunk_bounds = NULL;
+}
+
+// Attribute volumes
+
+// The values of one block in every attribute volume
+void get_block_attributes(int x, int y, int z, unsigned char values[ATTRIBUTE_VOLUME_AMOUNT][3]) {
+	memset(values, 0, sizeof(unsigned char) * ATTRIBUTE_VOLUME_AMOUNT * 3);
+	struct block block = get_block(x, y, z);
+	if(block.type != TYPE_AIR) {
+		// Palette levels as 8-bit channel values
+		unsigned int shade = get_block_shade(x, y, z);
+		unsigned char *color = values[ATTRIBUTE_VOLUME_COLOR];
+		color[0] = (unsigned char) (64 + (shade & (PALETTE_LEVELS - 1)));
+		color[1] = (unsigned char) (64 + ((shade >> PALETTE_BITS) & (PALETTE_LEVELS - 1)));
+		color[2] = (unsigned char) (64 + ((shade >> (PALETTE_BITS * 2)) & (PALETTE_LEVELS - 1)));
+	} else if(block.data != 0) {
+		struct occlusion *occlusion = occlusion_slots + block.data;
+		unsigned char *first = values[ATTRIBUTE_VOLUME_OCCLUSION_RIGHT_LEFT_UP];
+		unsigned char *second = values[ATTRIBUTE_VOLUME_OCCLUSION_DOWN_FRONT_BACK];
+		first[0] = occlusion->right;
+		first[1] = occlusion->left;
+		first[2] = occlusion->up;
+		second[0] = occlusion->down;
+		second[1] = occlusion->front;
+		second[2] = occlusion->back;
+	}
+}
+
+void fill_attribute_volumes() {
+	size_t cells = WORLD_SIZE_XYZ;
+	for(int i = 0; i < ATTRIBUTE_VOLUME_AMOUNT; i++) {
+		free(attribute_volumes[i]);
+		attribute_volumes[i] = (unsigned char *) calloc(cells, 3);
+		if(attribute_volumes[i] == NULL) {
+			fprintf(stderr, "Could not allocate attribute volumes\n");
+			exit(1);
+		}
+	}
+
+	for(int z = 0; z < world_size_z; z++) {
+		for(int y = 0; y < world_size_y; y++) {
+			for(int x = 0; x < world_size_x; x++) {
+				size_t index = 3 * ((size_t) x + (size_t) world_size_x * ((size_t) y + (size_t) world_size_y * (size_t) z));
+				unsigned char values[ATTRIBUTE_VOLUME_AMOUNT][3];
+				get_block_attributes(x, y, z, values);
+				for(int i = 0; i < ATTRIBUTE_VOLUME_AMOUNT; i++) {
+					memcpy(attribute_volumes[i] + index, values[i], 3);
+				}
+			}
+		}
+	}
+}
+
+void free_attribute_volumes() {
+	for(int i = 0; i < ATTRIBUTE_VOLUME_AMOUNT; i++) {
+		free(attribute_volumes[i]);
+		attribute_volumes[i] = NULL;
+	}
+}
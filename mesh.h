@@ -0,0 +1,41 @@
+#ifndef _MESH_H
+#define _MESH_H
+
+#include "world.h"
+
+// Mesh flags
+#define MESH_GREEDY 1	// Merge neighbouring faces with equal attributes into larger quads
+#define MESH_TEXTURED 2	// Leave colour and occlusion to the attribute volumes, so all coplanar faces merge
+
+// RGB volumes the size of the world: stone colours, and the six occlusion values of AIR blocks
+#define ATTRIBUTE_VOLUME_COLOR 0
+#define ATTRIBUTE_VOLUME_OCCLUSION_RIGHT_LEFT_UP 1
+#define ATTRIBUTE_VOLUME_OCCLUSION_DOWN_FRONT_BACK 2
+#define ATTRIBUTE_VOLUME_AMOUNT 3
+
+#define INDICES_PER_QUAD 6
+
+// Box around the vertices of a chunk
+struct mesh_bounds {
+	struct vec3 min;
+	struct vec3 max;
+};
+
+extern struct vertex *vertex_buffer_data;
+extern unsigned int vertex_amount;
+extern unsigned int *face_vertex_offsets;	// First vertex per chunk index and face orientation (chunk * FACE_AMOUNT + face), plus the total at the end
+extern struct mesh_bounds *chunk_bounds;
+
+extern unsigned char *attribute_volumes[ATTRIBUTE_VOLUME_AMOUNT];
+
+void fill_vertex_buffer(int flags);
+unsigned int remesh_chunks(const int *chunk_indices, int amount);
+void use_vertex_buffer(struct vertex *vertices, unsigned int amount, const unsigned int *offsets, const struct mesh_bounds *bounds, int flags);
+void free_vertex_buffer(void);
+unsigned int *create_quad_indices(unsigned int quad_amount);
+
+void get_block_attributes(int x, int y, int z, unsigned char values[ATTRIBUTE_VOLUME_AMOUNT][3]);
+void fill_attribute_volumes(void);
+void free_attribute_volumes(void);
+
+#endif /* !defined _MESH_H */
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "util.h"
+#include "metrics.h"
+
+struct phase_metric {
+	unsigned int count;
+	double total;
+	double max;
+};
+
+struct histogram {
+	unsigned int buckets[HISTOGRAM_BUCKETS];
+	unsigned int count;
+	double total;
+	double max;
+};
+
+// Globals
+
+static struct phase_metric phases[METRIC_PHASE_AMOUNT];
+static unsigned long long counters[METRIC_COUNTER_AMOUNT];
+static struct histogram histograms[METRIC_HISTOGRAM_AMOUNT];
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *phase_names[METRIC_PHASE_AMOUNT] = {"height_map", "blocks", "occupancy", "occlusion", "vertex_buffer", "edit", "shaders", "upload", "region", "first_frame", "final_frame"};
+static const char *counter_names[METRIC_COUNTER_AMOUNT] = {"rays_traced", "cells_visited", "vertices_emitted", "bytes_uploaded", "regions_baked", "regions_evicted"};
+static const char *histogram_names[METRIC_HISTOGRAM_AMOUNT] = {"frame", "display", "submit"};
+
+// Functions
+
+double begin_phase() {
+	return current_time();
+}
+
+void end_phase(int phase, double start) {
+	double seconds = current_time() - start;
+	pthread_mutex_lock(&metrics_lock);
+	struct phase_metric *metric = phases + phase;
+	metric->count++;
+	metric->total += seconds;
+	if(seconds > metric->max) {
+		metric->max = seconds;
+	}
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+void count_metric(int counter, unsigned long long amount) {
+	pthread_mutex_lock(&metrics_lock);
+	counters[counter] += amount;
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+void record_duration(int histogram, double seconds) {
+	struct histogram *current = histograms + histogram;
+	if(seconds < 0.0) {
+		seconds = 0.0;
+	}
+	double bucket = seconds / HISTOGRAM_BUCKET_SECONDS;
+	pthread_mutex_lock(&metrics_lock);
+	current->buckets[(bucket < HISTOGRAM_BUCKETS - 1) ? (int) bucket : HISTOGRAM_BUCKETS - 1]++;
+	current->count++;
+	current->total += seconds;
+	if(seconds > current->max) {
+		current->max = seconds;
+	}
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+// Upper bound of the bucket holding the given fraction of the durations, in seconds; the largest duration caps it
+static double locked_percentile(int histogram, double percentile) {
+	const struct histogram *current = histograms + histogram;
+	if(current->count == 0) {
+		return 0.0;
+	}
+	unsigned long long rank = (unsigned long long) ceil(percentile * current->count);
+	if(rank < 1) {
+		rank = 1;
+	}
+	unsigned long long seen = 0;
+	for(int i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+		seen += current->buckets[i];
+		if(seen >= rank) {
+			double upper = (i + 1) * HISTOGRAM_BUCKET_SECONDS;
+			return (upper < current->max) ? upper : current->max;
+		}
+	}
+	return current->max;
+}
+
+double histogram_percentile(int histogram, double percentile) {
+	pthread_mutex_lock(&metrics_lock);
+	double seconds = locked_percentile(histogram, percentile);
+	pthread_mutex_unlock(&metrics_lock);
+	return seconds;
+}
+
+// One JSON object with every phase, counter and histogram; durations in milliseconds
+void write_metrics(FILE *file) {
+	pthread_mutex_lock(&metrics_lock);
+	fprintf(file, "{\n\t\"phases\": {\n");
+	for(int i = 0; i < METRIC_PHASE_AMOUNT; i++) {
+		const struct phase_metric *metric = phases + i;
+		fprintf(file, "\t\t\"%s\": {\"count\": %u, \"total_ms\": %.3f, \"max_ms\": %.3f}%s\n", phase_names[i], metric->count, metric->total * 1000.0, metric->max * 1000.0, (i < METRIC_PHASE_AMOUNT - 1) ? "," : "");
+	}
+	fprintf(file, "\t},\n\t\"counters\": {\n");
+	for(int i = 0; i < METRIC_COUNTER_AMOUNT; i++) {
+		fprintf(file, "\t\t\"%s\": %llu%s\n", counter_names[i], counters[i], (i < METRIC_COUNTER_AMOUNT - 1) ? "," : "");
+	}
+	fprintf(file, "\t},\n\t\"histograms\": {\n");
+	for(int i = 0; i < METRIC_HISTOGRAM_AMOUNT; i++) {
+		const struct histogram *current = histograms + i;
+		double mean = (current->count > 0) ? current->total / current->count : 0.0;
+		fprintf(file, "\t\t\"%s\": {\"count\": %u, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}%s\n", histogram_names[i], current->count, mean * 1000.0, locked_percentile(i, 0.50) * 1000.0, locked_percentile(i, 0.95) * 1000.0, locked_percentile(i, 0.99) * 1000.0, current->max * 1000.0, (i < METRIC_HISTOGRAM_AMOUNT - 1) ? "," : "");
+	}
+	fprintf(file, "\t}\n}\n");
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+bool dump_metrics(const char *filename) {
+	FILE *file = fopen(filename, "w");
+	if(file == NULL) {
+		fprintf(stderr, "Unable to open %s for writing\n", filename);
+		return false;
+	}
+	write_metrics(file);
+	if(fclose(file) != 0) {
+		fprintf(stderr, "Could not write %s\n", filename);
+		return false;
+	}
+	fprintf(stderr, "Wrote metrics to %s\n", filename);
+	return true;
+}
+
+void reset_metrics() {
+	pthread_mutex_lock(&metrics_lock);
+	memset(phases, 0, sizeof(phases));
+	memset(counters, 0, sizeof(counters));
+	memset(histograms, 0, sizeof(histograms));
+	pthread_mutex_unlock(&metrics_lock);
+}
@@ -0,0 +1,51 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Phases timed from begin_phase() to end_phase(); a phase can run more than once
+#define METRIC_PHASE_HEIGHT_MAP 0
+#define METRIC_PHASE_BLOCKS 1
+#define METRIC_PHASE_OCCUPANCY 2
+#define METRIC_PHASE_OCCLUSION 3
+#define METRIC_PHASE_VERTEX_BUFFER 4
+#define METRIC_PHASE_EDIT 5
+#define METRIC_PHASE_SHADERS 6
+#define METRIC_PHASE_UPLOAD 7
+#define METRIC_PHASE_REGION 8	// All of the above for one streamed region
+#define METRIC_PHASE_FIRST_FRAME 9	// From the start of world_init until a frame is drawn
+#define METRIC_PHASE_FINAL_FRAME 10	// Until a frame with the occluded mesh is drawn
+#define METRIC_PHASE_AMOUNT 11
+
+// Running totals
+#define METRIC_COUNTER_RAYS_TRACED 0
+#define METRIC_COUNTER_CELLS_VISITED 1
+#define METRIC_COUNTER_VERTICES_EMITTED 2
+#define METRIC_COUNTER_BYTES_UPLOADED 3
+#define METRIC_COUNTER_REGIONS_BAKED 4
+#define METRIC_COUNTER_REGIONS_EVICTED 5
+#define METRIC_COUNTER_AMOUNT 6
+
+// Distributions of durations: time from one frame to the next (or until it's finished, offscreen), the time spent
+// drawing one, and the time spent handing its commands to GL
+#define METRIC_HISTOGRAM_FRAME 0
+#define METRIC_HISTOGRAM_DISPLAY 1
+#define METRIC_HISTOGRAM_SUBMIT 2
+#define METRIC_HISTOGRAM_AMOUNT 3
+
+// Histogram buckets are 0.1 ms wide; the last one takes everything from 100 ms on
+#define HISTOGRAM_BUCKET_SECONDS 0.0001
+#define HISTOGRAM_BUCKETS 1001
+
+// Any thread can call these; streamed worlds bake in the background while the main thread draws
+double begin_phase(void);
+void end_phase(int phase, double start);
+void count_metric(int counter, unsigned long long amount);
+void record_duration(int histogram, double seconds);
+double histogram_percentile(int histogram, double percentile);
+void write_metrics(FILE *file);
+bool dump_metrics(const char *filename);
+void reset_metrics(void);
+
+#endif /* !defined _METRICS_H */
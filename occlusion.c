@@ -1,12 +1,71 @@
 #include <stdlib.h>
-#include <GL/glew.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
+#include <stdatomic.h>
 
+#include "terrain.h"
+#include "occupancy.h"
+#include "thread.h"
+#include "raypacket.h"
+#include "metrics.h"
+#include "util.h"
 #include "occlusion.h"
 
+// A grid of columns both candidate kernels trace, twice each, before a height map world picks one to bake with
+#define KERNEL_SAMPLE_GRID 16
+#define KERNEL_SAMPLE_COLUMNS (KERNEL_SAMPLE_GRID * KERNEL_SAMPLE_GRID)
+#define KERNEL_SAMPLE_ROUNDS 2
+
+// Globals
+
+unsigned long long rays_traced = 0;
+unsigned long long cells_visited = 0;
+int ray_length = OFFSET_AMOUNT;
+
+// Kept after calculate_occlusion() for recalculating single blocks
+static struct ray *occlusion_rays = NULL;
+static struct directions occlusion_face_totals;
+
+// Per ray, the cells it crosses as offsets from the block it starts in; for the pyramid kernel and for edits
+static short (*ray_cells)[OFFSET_AMOUNT][3] = NULL;
+
+// Per ray and axis, the index of the first cell that is a given distance along the axis from where the ray starts,
+// or OFFSET_AMOUNT if it never gets there; finds where a ray leaves an empty block for the pyramid kernel
+static short (*ray_exits)[3][OFFSET_AMOUNT + 1] = NULL;
+
+// The same cells by column (x, z, lowest y, highest y), for the height map kernel
+static short (*ray_columns)[OFFSET_AMOUNT][4] = NULL;
+static int ray_column_amounts[RAY_AMOUNT];
+
+// The same cells, interleaved per packet of rays for the packet kernels
+static struct ray_packet *ray_packets = NULL;
+
+// The kernel asked for; OCCLUSION_KERNEL_AUTO picks the best voxel kernel, or whichever of it and the height map kernel
+// traces a sample of the world faster when the height map kernel applies
+int occlusion_kernel = OCCLUSION_KERNEL_AUTO;
+static int voxel_kernel = OCCLUSION_KERNEL_AUTO;
+
+// The last pick, for worlds of the same size
+static int measured_kernel = OCCLUSION_KERNEL_AUTO;
+static int measured_size[3] = {0, 0, 0};
+static const char *kernel_names[OCCLUSION_KERNEL_AMOUNT] = {"scalar", "table", "avx2", "pyramid", "heightmap"};
+
+struct occlusion_job {
+	struct ray *rays;
+	struct directions face_totals;
+	const size_t *blocks;	// Blocks to recalculate by index, or NULL for whole columns
+	int kernel;
+	int max_height;	// Highest column, for the height map kernel
+	bool verify;	// Compare with the stored values instead of storing
+	atomic_ullong rays_traced;
+	atomic_ullong cells_visited;
+	atomic_uint mismatches;
+	atomic_uint max_difference;
+};
+
 static void dump_ray(struct ray *ray) {
 	fprintf(stderr, "Dumping ray:\n");
 	fprintf(stderr, "\tx = %f\n", ray->x);
@@ -38,6 +97,12 @@ static struct ray *generate_rays(int amount) {
 		rays[i].x = (float) (cos(phi) * r);
 		rays[i].y = (float) y;
 		rays[i].z = (float) (sin(phi) * r);
+		// Traversal parameters: the direction to step in and the ray length per crossed cell, per axis
+		float direction[3] = {rays[i].x, rays[i].y, rays[i].z};
+		for(int axis = 0; axis < 3; axis++) {
+			rays[i].step[axis] = (direction[axis] < 0) ? -1 : 1;
+			rays[i].delta[axis] = (direction[axis] < 0 || direction[axis] > 0) ? 1 / fabsf(direction[axis]) : HUGE_VALF;
+		}
 		// Determine from which faces the ray 'escapes'
 		rays[i].colliding.right = (rays[i].x < 0) ? -rays[i].x : 0.0f;
 		rays[i].colliding.left = (rays[i].x > 0) ? rays[i].x : 0.0f;
@@ -50,68 +115,341 @@ static struct ray *generate_rays(int amount) {
 	return rays;
 }
 
-static struct offset *generate_intersecting_offsets(struct ray *ray, int amount) {
-	struct offset *offsets = (struct offset *) malloc(sizeof(struct offset) * (unsigned int) amount);
-	assert(offsets != NULL);
+// Ray length at which a ray starting in the center of a cell takes its (steps+1)th step along an axis
+static inline float crossing(const struct ray *ray, int axis, int steps) {
+	return ((float) steps + 0.5f) * ray->delta[axis];
+}
+
+// Whether the step along axis at length t comes before the step along axis other at length t_other; ties go to the lower axis
+static inline bool precedes(float t, int axis, float t_other, int other) {
+	return t < t_other || (axis < other && t <= t_other);
+}
+
+// Amount of cells a ray starting at (x,y,z) crosses before it leaves the world
+static int cells_inside_world(const struct ray *ray, int x, int y, int z) {
+	int position[3] = {x, y, z};
+	int size[3] = {world_size_x, world_size_y, world_size_z};
+
+	// Cells left until the boundary along every axis, and the step that crosses the boundary first
+	int remaining[3];
+	int exit_axis = 0;
+	float exit_t = HUGE_VALF;
+	for(int axis = 0; axis < 3; axis++) {
+		remaining[axis] = (ray->step[axis] > 0) ? size[axis] - 1 - position[axis] : position[axis];
+		float t = crossing(ray, axis, remaining[axis]);
+		if(precedes(t, axis, exit_t, exit_axis)) {
+			exit_t = t;
+			exit_axis = axis;
+		}
+	}
+
+	// Count the steps along every axis that happen before that
+	int cells = remaining[exit_axis];
+	for(int axis = 0; axis < 3; axis++) {
+		if(axis == exit_axis || isinf(ray->delta[axis])) {
+			continue;
+		}
+		int steps = (int) (exit_t / ray->delta[axis] - 0.5f);
+		if(steps < 0) {
+			steps = 0;
+		} else if(steps > remaining[axis]) {
+			steps = remaining[axis];
+		}
+		while(steps < remaining[axis] && precedes(crossing(ray, axis, steps), axis, exit_t, exit_axis)) {
+			steps++;
+		}
+		while(steps > 0 && !precedes(crossing(ray, axis, steps - 1), axis, exit_t, exit_axis)) {
+			steps--;
+		}
+		cells += steps;
+	}
+
+	return cells;
+}
+
+// Walk the cells crossed by a ray from the center of (x,y,z) (Amanatides & Woo); true if it hits a solid block
+static bool trace_ray(const struct ray *ray, int x, int y, int z, unsigned int *visited_cells) {
+	int cells = cells_inside_world(ray, x, y, z);
+	if(cells > ray_length) {
+		cells = ray_length;
+	}
 
-	// Ray has unit length; scale to make steps of 0.2
-	float sx = ray->x * 0.2f;
-	float sy = ray->y * 0.2f;
-	float sz = ray->z * 0.2f;
+	int position[3] = {x, y, z};
+	int steps[3] = {0, 0, 0};
+	float t[3] = {crossing(ray, 0, 0), crossing(ray, 1, 0), crossing(ray, 2, 0)};
 
-	// The current position
-	float x = 0;
-	float y = 0;
-	float z = 0;
+	for(int i = 0; i < cells; i++) {
+		int axis;
+		if(t[0] <= t[1] && t[0] <= t[2]) {
+			axis = 0;
+		} else if(t[1] <= t[2]) {
+			axis = 1;
+		} else {
+			axis = 2;
+		}
+		position[axis] += ray->step[axis];
+		t[axis] = crossing(ray, axis, ++steps[axis]);
+
+		if(is_solid(position[0], position[1], position[2])) {
+			*visited_cells += (unsigned int) i + 1;
+			return true;
+		}
+	}
+
+	*visited_cells += (unsigned int) cells;
+	return false;
+}
+
+// Index of the first cell after the block of 1 << shift cells around cell that a ray from origin crosses
+static inline int leave_block(const short (*exits)[OFFSET_AMOUNT + 1], const int step[3], const int origin[3], const int cell[3], int shift) {
+	int exit = OFFSET_AMOUNT;
+	for(int axis = 0; axis < 3; axis++) {
+		int first = cell[axis] >> shift << shift;
+		int distance = (step[axis] > 0) ? first + (1 << shift) - origin[axis] : origin[axis] - first + 1;
+		if(distance <= OFFSET_AMOUNT && exits[axis][distance] < exit) {
+			exit = exits[axis][distance];
+		}
+	}
+	return exit;
+}
 
-	// The cell a point was last added for
-	int last_x = 0;
-	int last_y = 0;
-	int last_z = 0;
+// Walks the precomputed cells like the table kernel, but on a cell in an empty brick it leaps to the first cell
+// outside the largest empty block around it, and a rising ray ends above the highest solid block
+static bool trace_pyramid_ray(int r, int x, int y, int z, unsigned int *visited_cells) {
+	const short (*cells)[3] = ray_cells[r];
+	const short (*exits)[OFFSET_AMOUNT + 1] = ray_exits[r];
+	const int *step = occlusion_rays[r].step;
+	int origin[3] = {x, y, z};
+	int size_y = (step[1] > 0 && solid_height < world_size_y) ? solid_height : world_size_y;
+	int bricks_x = BRICKS_X;
+	int bricks_xy = BRICKS_X * BRICKS_Y;
+	int length = ray_length;
 
+	unsigned int visited = 0;
+	bool hit = false;
 	int i = 0;
-	while(i < amount) {
-		// Round towards zero to get the block coordinate
-		int new_x = (int) x;
-		int new_y = (int) y;
-		int new_z = (int) z;
-		if(new_x != last_x || new_y != last_y || new_z != last_z) {
-			// Arrived in a new block; add to offsets
-			offsets[i].x = new_x;
-			offsets[i].y = new_y;
-			offsets[i].z = new_z;
-			last_x = new_x;
-			last_y = new_y;
-			last_z = new_z;
+	while(i < length) {
+		visited++;
+		int cell[3] = {x + cells[i][0], y + cells[i][1], z + cells[i][2]};
+		if((unsigned int) cell[0] >= (unsigned int) world_size_x || (unsigned int) cell[1] >= (unsigned int) size_y || (unsigned int) cell[2] >= (unsigned int) world_size_z) {
+			break;
+		}
+
+		uint64_t brick = occupancy[(cell[0] >> BRICK_SHIFT) + (cell[1] >> BRICK_SHIFT) * bricks_x + (cell[2] >> BRICK_SHIFT) * bricks_xy];
+		if(brick != 0) {
+			int bit = (cell[0] & BRICK_MASK) | (cell[1] & BRICK_MASK) << BRICK_SHIFT | (cell[2] & BRICK_MASK) << (BRICK_SHIFT * 2);
+			if((brick >> bit) & 1) {
+				hit = true;
+				break;
+			}
 			i++;
-#if 0
-			// Render the offsets (starting at the center of the map) as red blocks
-			struct block *tmp = get_block(new_x + WORLD_SIZE_X / 2, new_y + WORLD_SIZE_Y / 2, new_z + WORLD_SIZE_Z / 2);
-			if(tmp != NULL) {
-				tmp->type = TYPE_STONE;
-				tmp->color.r = 1.0f;
-				tmp->color.g = 0.0f;
-				tmp->color.b = 0.0f;
+			continue;
+		}
+
+		// Cells outside the world are empty in every level too, and the ray doesn't come back in after them
+		int shift = BRICK_SHIFT;
+		for(int level = 0; level < OCCUPANCY_LEVELS; level++) {
+			const struct occupancy_level *current = occupancy_levels + level;
+			if(current->cells[get_level_index(current, cell[0], cell[1], cell[2])] != 0) {
+				break;
+			}
+			shift = current->shift;
+		}
+		i = leave_block(exits, step, origin, cell, shift);
+	}
+
+	*visited_cells += visited;
+	return hit;
+}
+
+static inline int get_column_height(int x, int z) {
+	return height_map[(size_t) x + (size_t) z * (size_t) world_size_x];
+}
+
+// A cell is solid when it is below its column's height, so a ray only needs the lowest cell it crosses in every column.
+// Crossing the columns in order keeps the order of trace_ray, so hits and leaving the world happen at the same cells.
+static bool trace_column_ray(const struct occlusion_job *job, int r, int x, int y, int z, unsigned int *visited_cells) {
+	const short (*columns)[4] = ray_columns[r];
+	bool rising = occlusion_rays[r].step[1] > 0;
+	for(int i = 0; i < ray_column_amounts[r]; i++) {
+		(*visited_cells)++;
+		int cx = x + columns[i][0];
+		int cz = z + columns[i][1];
+		int low = y + columns[i][2];
+		int high = y + columns[i][3];
+		if((unsigned int) cx >= (unsigned int) world_size_x || (unsigned int) cz >= (unsigned int) world_size_z) {
+			return false;
+		}
+
+		if(rising) {
+			// The lowest cell comes first; above the highest column nothing can be hit any more
+			if(low >= job->max_height || low >= world_size_y) {
+				return false;
+			}
+			if(low < get_column_height(cx, cz)) {
+				return true;
+			}
+		} else {
+			// The lowest cell comes last, unless the ray leaves the world through the bottom first
+			if(high < 0) {
+				return false;
+			}
+			if((low < 0 ? 0 : low) < get_column_height(cx, cz)) {
+				return true;
+			}
+			if(low < 0) {
+				return false;
+			}
+		}
+	}
+
+	return false;
+}
+
+// The cells a ray crosses don't depend on where it starts, as it always starts in the center of a cell
+static void walk_ray(int r, short (*cells)[3]) {
+	const struct ray *ray = occlusion_rays + r;
+	int position[3] = {0, 0, 0};
+	int steps[3] = {0, 0, 0};
+	float t[3] = {crossing(ray, 0, 0), crossing(ray, 1, 0), crossing(ray, 2, 0)};
+
+	// Same walk as trace_ray
+	for(int i = 0; i < OFFSET_AMOUNT; i++) {
+		int axis;
+		if(t[0] <= t[1] && t[0] <= t[2]) {
+			axis = 0;
+		} else if(t[1] <= t[2]) {
+			axis = 1;
+		} else {
+			axis = 2;
+		}
+		position[axis] += ray->step[axis];
+		t[axis] = crossing(ray, axis, ++steps[axis]);
+
+		for(int k = 0; k < 3; k++) {
+			cells[i][k] = (short) position[k];
+		}
+	}
+}
+
+static void generate_ray_cells(void) {
+	ray_cells = (short (*)[OFFSET_AMOUNT][3]) malloc(sizeof(*ray_cells) * RAY_AMOUNT);
+	if(ray_cells == NULL) {
+		fprintf(stderr, "Could not allocate ray cells\n");
+		exit(1);
+	}
+
+	for(int r = 0; r < RAY_AMOUNT; r++) {
+		walk_ray(r, ray_cells[r]);
+	}
+}
+
+static void generate_ray_exits(void) {
+	ray_exits = (short (*)[3][OFFSET_AMOUNT + 1]) malloc(sizeof(*ray_exits) * RAY_AMOUNT);
+	if(ray_exits == NULL) {
+		fprintf(stderr, "Could not allocate ray exits\n");
+		exit(1);
+	}
+
+	// A ray moves at most one cell along an axis per step, so it is at every distance up to the furthest in turn
+	for(int r = 0; r < RAY_AMOUNT; r++) {
+		for(int axis = 0; axis < 3; axis++) {
+			for(int distance = 0; distance <= OFFSET_AMOUNT; distance++) {
+				ray_exits[r][axis][distance] = OFFSET_AMOUNT;
+			}
+			for(int i = OFFSET_AMOUNT - 1; i >= 0; i--) {
+				ray_exits[r][axis][abs(ray_cells[r][i][axis])] = (short) i;
+			}
+		}
+	}
+}
+
+// Groups the cells of every ray up to its length into the columns they are in, with the lowest and highest cell per column
+static void generate_ray_columns(void) {
+	ray_columns = (short (*)[OFFSET_AMOUNT][4]) malloc(sizeof(*ray_columns) * RAY_AMOUNT);
+	if(ray_columns == NULL) {
+		fprintf(stderr, "Could not allocate ray columns\n");
+		exit(1);
+	}
+
+	for(int r = 0; r < RAY_AMOUNT; r++) {
+		short cells[OFFSET_AMOUNT][3];
+		walk_ray(r, cells);
+		int amount = 0;
+		for(int i = 0; i < ray_length; i++) {
+			const short *cell = cells[i];
+			short *column = ray_columns[r][amount - 1];
+			if(amount > 0 && column[0] == cell[0] && column[1] == cell[2]) {
+				if(cell[1] < column[2]) {
+					column[2] = cell[1];
+				}
+				if(cell[1] > column[3]) {
+					column[3] = cell[1];
+				}
+				continue;
 			}
-#endif
+			column = ray_columns[r][amount++];
+			column[0] = cell[0];
+			column[1] = cell[2];
+			column[2] = cell[1];
+			column[3] = cell[1];
 		}
-		x += sx;
-		y += sy;
-		z += sz;
+		ray_column_amounts[r] = amount;
 	}
+}
+
+// Orders the rays of one latitude band by longitude
+static int compare_longitude(const void *a, const void *b) {
+	const struct ray *ray_a = occlusion_rays + *(const int *) a;
+	const struct ray *ray_b = occlusion_rays + *(const int *) b;
+	float longitude_a = atan2f(ray_a->z, ray_a->x);
+	float longitude_b = atan2f(ray_b->z, ray_b->x);
+	return (longitude_a > longitude_b) - (longitude_a < longitude_b);
+}
 
-	return offsets;
+// A packet runs until its last ray ends, so it takes rays with similar directions: neighbours in a band of latitude
+static void generate_ray_packets(void) {
+	ray_packets = (struct ray_packet *) malloc(sizeof(struct ray_packet) * PACKET_AMOUNT);
+	if(ray_packets == NULL) {
+		fprintf(stderr, "Could not allocate ray packets\n");
+		exit(1);
+	}
+
+	// The rays are generated from bottom to top, so consecutive rays share a band
+	int order[RAY_AMOUNT];
+	for(int r = 0; r < RAY_AMOUNT; r++) {
+		order[r] = r;
+	}
+	for(int band = 0; band < PACKET_BANDS; band++) {
+		qsort(order + band * (RAY_AMOUNT / PACKET_BANDS), RAY_AMOUNT / PACKET_BANDS, sizeof(int), compare_longitude);
+	}
+
+	for(int p = 0; p < PACKET_AMOUNT; p++) {
+		struct ray_packet *packet = ray_packets + p;
+		for(int lane = 0; lane < PACKET_LANES; lane++) {
+			int r = order[p * PACKET_LANES + lane];
+			packet->rays[lane] = r;
+			packet->rising[lane] = occlusion_rays[r].step[1] > 0;
+			short cells[OFFSET_AMOUNT][3];
+			walk_ray(r, cells);
+			for(int i = 0; i < OFFSET_AMOUNT; i++) {
+				for(int k = 0; k < 3; k++) {
+					packet->cells[i][k][lane] = cells[i][k];
+				}
+			}
+		}
+	}
 }
 
-static struct directions calculate_face_totals(struct ray *rays) {
+static struct directions calculate_face_totals(void) {
 	struct directions totals = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
 	for(int i = 0; i < RAY_AMOUNT; i++) {
-		totals.right += rays[i].colliding.right;
-		totals.left += rays[i].colliding.left;
-		totals.up += rays[i].colliding.up;
-		totals.down += rays[i].colliding.down;
-		totals.front += rays[i].colliding.front;
-		totals.back += rays[i].colliding.back;
+		totals.right += occlusion_rays[i].colliding.right;
+		totals.left += occlusion_rays[i].colliding.left;
+		totals.up += occlusion_rays[i].colliding.up;
+		totals.down += occlusion_rays[i].colliding.down;
+		totals.front += occlusion_rays[i].colliding.front;
+		totals.back += occlusion_rays[i].colliding.back;
 	}
 
 	float epsilon = 0.000001f;
@@ -126,8 +464,8 @@ static struct directions calculate_face_totals(struct ray *rays) {
 		fprintf(stderr, "Error: not enough light colliding with one of the faces\n");
 		dump_directions(&totals);
 		for(int i = 0; i < RAY_AMOUNT; i++) {
-			dump_ray(&rays[i]);
-			dump_directions(&(rays[i].colliding));
+			dump_ray(&occlusion_rays[i]);
+			dump_directions(&(occlusion_rays[i].colliding));
 		}
 		exit(1);
 	}
@@ -135,81 +473,369 @@ static struct directions calculate_face_totals(struct ray *rays) {
 	return totals;
 }
 
-void calculate_occlusion() {
-	fprintf(stderr, "Generating %d rays\n", RAY_AMOUNT);
-	struct ray *rays = generate_rays(RAY_AMOUNT);
-	struct directions face_totals = calculate_face_totals(rays);
+static inline unsigned char quantize(float value) {
+	if(value <= 0) {
+		return 0;
+	}
+	if(value >= 1) {
+		return 255;
+	}
+	return (unsigned char) lroundf(value * 255);
+}
+
+// Whether every ray hits a solid block
+static void trace_rays(const struct occlusion_job *job, int x, int y, int z, bool hits[RAY_AMOUNT], unsigned int *visited_cells) {
+	if(job->kernel == OCCLUSION_KERNEL_SCALAR) {
+		for(int i = 0; i < RAY_AMOUNT; i++) {
+			hits[i] = trace_ray(job->rays + i, x, y, z, visited_cells);
+		}
+		return;
+	}
+
+	if(job->kernel == OCCLUSION_KERNEL_PYRAMID) {
+		for(int i = 0; i < RAY_AMOUNT; i++) {
+			hits[i] = trace_pyramid_ray(i, x, y, z, visited_cells);
+		}
+		return;
+	}
 
-	fprintf(stderr, "Generating %d ray offsets per ray (%d total)\n", OFFSET_AMOUNT, RAY_AMOUNT * OFFSET_AMOUNT);
-	struct offset *ray_offsets[RAY_AMOUNT];
+	if(job->kernel == OCCLUSION_KERNEL_HEIGHT_MAP) {
+		for(int i = 0; i < RAY_AMOUNT; i++) {
+			hits[i] = trace_column_ray(job, i, x, y, z, visited_cells);
+		}
+		return;
+	}
+
+	packet_kernel kernel = (job->kernel == OCCLUSION_KERNEL_AVX2) ? trace_packet_avx2 : trace_packet_table;
+	for(int p = 0; p < PACKET_AMOUNT; p++) {
+		const struct ray_packet *packet = ray_packets + p;
+		unsigned int packet_hits = kernel(packet, x, y, z, visited_cells);
+		for(int lane = 0; lane < PACKET_LANES; lane++) {
+			hits[packet->rays[lane]] = (packet_hits & (1u << lane)) != 0;
+		}
+	}
+}
+
+static void occlude_block(struct occlusion_job *job, int x, int y, int z, unsigned int *visited_cells) {
+	struct block block = get_block(x, y, z);
+	struct directions light = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+
+	bool hits[RAY_AMOUNT];
+	trace_rays(job, x, y, z, hits, visited_cells);
+
+	int escaped = 0;
 	for(int i = 0; i < RAY_AMOUNT; i++) {
-		ray_offsets[i] = generate_intersecting_offsets(rays + i, OFFSET_AMOUNT);
-	}
-
-	// Calculate occlusion per face
-	fprintf(stderr, "Calculating face occlusion\n");
-	for(int x = 0; x < WORLD_SIZE_X; x++) {
-		for(int y = 0; y < WORLD_SIZE_Y; y++) {
-			for(int z = 0; z < WORLD_SIZE_Z; z++) {
-				// Only calculate occlusion for AIR blocks with neighbors
-				struct block *block = get_block(x, y, z);
-				if(block->type != TYPE_AIR || !has_neighbors(x, y, z)) {
-					continue;
-				}
+		struct ray *ray = job->rays + i;
 
-				block->occlusion.right = 0;
-				block->occlusion.left = 0;
-				block->occlusion.up = 0;
-				block->occlusion.down = 0;
-				block->occlusion.front = 0;
-				block->occlusion.back = 0;
-
-				int escaped = 0;
-				for(int i = 0; i < RAY_AMOUNT; i++) {
-					struct ray *ray = rays + i;
-
-					bool collided = false;
-					for(int j = 0; j < OFFSET_AMOUNT; j++) {
-						int rx = x + ray_offsets[i][j].x;
-						int ry = y + ray_offsets[i][j].y;
-						int rz = z + ray_offsets[i][j].z;
-
-						if(rx < 0 || rx >= WORLD_SIZE_X || ry < 0 || ry >= WORLD_SIZE_Y || rz < 0 || rz >= WORLD_SIZE_Z) {
-							// Ray has escaped the world
-							break;
-						}
-						if(get_block(rx, ry, rz)->type != TYPE_AIR) {
-							collided = true;
-							break;
-						}
-					}
-					if(!collided) {
-						// Add light from escaped ray to the block face it would collide with
-						block->occlusion.right += ray->colliding.right;
-						block->occlusion.left += ray->colliding.left;
-						block->occlusion.up += ray->colliding.up;
-						block->occlusion.down += ray->colliding.down;
-						block->occlusion.front += ray->colliding.front;
-						block->occlusion.back += ray->colliding.back;
-
-						escaped++;
-					}
-				}
-				//fprintf(stderr, "%4d/%d rays escaped from (%d,%d,%d) = %d%%\n", escaped, RAY_AMOUNT, x, y, z, (int) (escaped * 100 / RAY_AMOUNT));
+		if(!hits[i]) {
+			// Add light from escaped ray to the block face it would collide with
+			light.right += ray->colliding.right;
+			light.left += ray->colliding.left;
+			light.up += ray->colliding.up;
+			light.down += ray->colliding.down;
+			light.front += ray->colliding.front;
+			light.back += ray->colliding.back;
+
+			escaped++;
+		}
+	}
+	//fprintf(stderr, "%4d/%d rays escaped from (%d,%d,%d) = %d%%\n", escaped, RAY_AMOUNT, x, y, z, (int) (escaped * 100 / RAY_AMOUNT));
 
-				// Normalize occlusion values
-				block->occlusion.right	= 1 - (block->occlusion.right / face_totals.right);
-				block->occlusion.left	= 1 - (block->occlusion.left / face_totals.left);
-				block->occlusion.up		= 1 - (block->occlusion.up / face_totals.up);
-				block->occlusion.down	= 1 - (block->occlusion.down / face_totals.down);
-				block->occlusion.front	= 1 - (block->occlusion.front / face_totals.front);
-				block->occlusion.back	= 1 - (block->occlusion.back / face_totals.back);
+	// Normalize and store occlusion values
+	struct occlusion result;
+	result.right	= quantize(1 - (light.right / job->face_totals.right));
+	result.left		= quantize(1 - (light.left / job->face_totals.left));
+	result.up		= quantize(1 - (light.up / job->face_totals.up));
+	result.down		= quantize(1 - (light.down / job->face_totals.down));
+	result.front	= quantize(1 - (light.front / job->face_totals.front));
+	result.back		= quantize(1 - (light.back / job->face_totals.back));
+
+	struct occlusion *occlusion = occlusion_slots + block.data;
+	if(!job->verify) {
+		*occlusion = result;
+	} else if(memcmp(occlusion, &result, sizeof(result)) != 0) {
+		atomic_fetch_add_explicit(&job->mismatches, 1, memory_order_relaxed);
+		unsigned int difference = 0;
+		for(size_t i = 0; i < sizeof(result); i++) {
+			int value = ((unsigned char *) occlusion)[i] - ((unsigned char *) &result)[i];
+			if((unsigned int) abs(value) > difference) {
+				difference = (unsigned int) abs(value);
 			}
 		}
+		unsigned int previous = atomic_load_explicit(&job->max_difference, memory_order_relaxed);
+		while(difference > previous && !atomic_compare_exchange_weak(&job->max_difference, &previous, difference));
 	}
+}
 
-	for(int i = 0; i < RAY_AMOUNT; i++) {
-		free(ray_offsets[i]);
+static void occlude_column(int index, void *data) {
+	struct occlusion_job *job = (struct occlusion_job *) data;
+	int x = index % world_size_x;
+	int z = index / world_size_x;
+
+	unsigned long long traced = 0;
+	unsigned long long visited = 0;
+	for(int y = 0; y < world_size_y; y++) {
+		// Only AIR blocks with neighbors have an occlusion slot
+		struct block block = get_block(x, y, z);
+		if(block.type != TYPE_AIR || block.data == 0) {
+			continue;
+		}
+		unsigned int block_visited = 0;
+		occlude_block(job, x, y, z, &block_visited);
+		traced += RAY_AMOUNT;
+		visited += block_visited;
+	}
+	atomic_fetch_add_explicit(&job->rays_traced, traced, memory_order_relaxed);
+	atomic_fetch_add_explicit(&job->cells_visited, visited, memory_order_relaxed);
+}
+
+static void occlude_listed_block(int index, void *data) {
+	struct occlusion_job *job = (struct occlusion_job *) data;
+	size_t block_index = job->blocks[index];
+	int x = (int) (block_index % (size_t) world_size_x);
+	int y = (int) (block_index / (size_t) world_size_x % (size_t) world_size_y);
+	int z = (int) (block_index / ((size_t) world_size_x * (size_t) world_size_y));
+
+	struct block block = get_block(x, y, z);
+	if(block.type != TYPE_AIR || block.data == 0) {
+		return;
+	}
+	unsigned int visited = 0;
+	occlude_block(job, x, y, z, &visited);
+	atomic_fetch_add_explicit(&job->rays_traced, RAY_AMOUNT, memory_order_relaxed);
+	atomic_fetch_add_explicit(&job->cells_visited, visited, memory_order_relaxed);
+}
+
+static void prepare_rays(void) {
+	if(occlusion_rays != NULL) {
+		return;
+	}
+	fprintf(stderr, "Generating %d rays\n", RAY_AMOUNT);
+	occlusion_rays = generate_rays(RAY_AMOUNT);
+	occlusion_face_totals = calculate_face_totals();
+}
+
+// Only the tables of kernels that run get built, so the others don't crowd the caches
+static void prepare_ray_cells(void) {
+	if(ray_cells == NULL) {
+		generate_ray_cells();
+	}
+}
+
+static void prepare_kernel(int kernel) {
+	if((kernel == OCCLUSION_KERNEL_TABLE || kernel == OCCLUSION_KERNEL_AVX2) && ray_packets == NULL) {
+		generate_ray_packets();
+	} else if(kernel == OCCLUSION_KERNEL_PYRAMID && ray_exits == NULL) {
+		prepare_ray_cells();
+		generate_ray_exits();
+	} else if(kernel == OCCLUSION_KERNEL_HEIGHT_MAP && ray_columns == NULL) {
+		generate_ray_columns();
+	}
+}
+
+static void setup_job(struct occlusion_job *job, const size_t *blocks, int kernel, bool verify) {
+	job->rays = occlusion_rays;
+	job->face_totals = occlusion_face_totals;
+	job->blocks = blocks;
+	job->kernel = kernel;
+	prepare_kernel(job->kernel);
+	job->max_height = 0;
+	if(job->kernel == OCCLUSION_KERNEL_HEIGHT_MAP) {
+		for(size_t i = 0; i < WORLD_SIZE_XZ; i++) {
+			if(height_map[i] > job->max_height) {
+				job->max_height = height_map[i];
+			}
+		}
 	}
-	free(rays);
+	job->verify = verify;
+	atomic_init(&job->rays_traced, 0);
+	atomic_init(&job->cells_visited, 0);
+	atomic_init(&job->mismatches, 0);
+	atomic_init(&job->max_difference, 0);
+}
+
+// The centers of a grid over the world
+static void occlude_sample_column(int index, void *data) {
+	int x = (index % KERNEL_SAMPLE_GRID * 2 + 1) * world_size_x / (KERNEL_SAMPLE_GRID * 2);
+	int z = (index / KERNEL_SAMPLE_GRID * 2 + 1) * world_size_z / (KERNEL_SAMPLE_GRID * 2);
+	occlude_column(x + z * world_size_x, data);
+}
+
+// Whether columns or cells are cheaper to walk depends on the world's size and shape and on the machine, so time both
+// on the same columns; needs the occlusion slots, and leaves the values the samples traced in them
+static int measure_kernels(void) {
+	if(measured_kernel != OCCLUSION_KERNEL_AUTO && measured_size[0] == world_size_x && measured_size[1] == world_size_y && measured_size[2] == world_size_z) {
+		return measured_kernel;
+	}
+
+	int candidates[2] = {voxel_kernel, OCCLUSION_KERNEL_HEIGHT_MAP};
+	double seconds[2] = {HUGE_VAL, HUGE_VAL};
+	for(int round = 0; round < KERNEL_SAMPLE_ROUNDS; round++) {
+		for(int candidate = 0; candidate < 2; candidate++) {
+			struct occlusion_job job;
+			setup_job(&job, NULL, candidates[candidate], false);
+			double start = current_time();
+			parallel_for(KERNEL_SAMPLE_COLUMNS, occlude_sample_column, &job);
+			double elapsed = current_time() - start;
+			if(elapsed < seconds[candidate]) {
+				seconds[candidate] = elapsed;
+			}
+		}
+	}
+	measured_kernel = (seconds[1] < seconds[0]) ? candidates[1] : candidates[0];
+	measured_size[0] = world_size_x;
+	measured_size[1] = world_size_y;
+	measured_size[2] = world_size_z;
+	fprintf(stderr, "Traced %d columns in %.3f ms with the %s kernel and %.3f ms with the %s kernel\n", KERNEL_SAMPLE_COLUMNS, seconds[0] * 1000.0, kernel_names[candidates[0]], seconds[1] * 1000.0, kernel_names[candidates[1]]);
+
+	// The other kernel's table goes again
+	if(measured_kernel == OCCLUSION_KERNEL_HEIGHT_MAP) {
+		free(ray_packets);
+		ray_packets = NULL;
+	} else {
+		free(ray_columns);
+		ray_columns = NULL;
+	}
+	return measured_kernel;
+}
+
+static int choose_kernel(int kernel) {
+	if(voxel_kernel == OCCLUSION_KERNEL_AUTO) {
+		voxel_kernel = avx2_supported() ? OCCLUSION_KERNEL_AVX2 : OCCLUSION_KERNEL_TABLE;
+	}
+	if(kernel == OCCLUSION_KERNEL_AUTO) {
+		kernel = occlusion_kernel;
+	}
+	if(kernel == OCCLUSION_KERNEL_HEIGHT_MAP && !world_matches_height_map) {
+		kernel = voxel_kernel;
+	} else if(kernel == OCCLUSION_KERNEL_AUTO) {
+		// In small worlds the sample would take as long as the bake
+		bool measure = world_matches_height_map && WORLD_SIZE_XZ >= (size_t) KERNEL_SAMPLE_COLUMNS * 16;
+		kernel = measure ? measure_kernels() : voxel_kernel;
+	}
+	return kernel;
+}
+
+// Occlusion slots must be assigned already, in case the kernel gets measured
+static void init_job(struct occlusion_job *job, const size_t *blocks, int kernel, bool verify) {
+	prepare_rays();
+	setup_job(job, blocks, choose_kernel(kernel), verify);
+}
+
+// Adds what a job traced to the totals
+static void count_traced(struct occlusion_job *job) {
+	unsigned long long traced = atomic_load(&job->rays_traced);
+	unsigned long long visited = atomic_load(&job->cells_visited);
+	rays_traced += traced;
+	cells_visited += visited;
+	count_metric(METRIC_COUNTER_RAYS_TRACED, traced);
+	count_metric(METRIC_COUNTER_CELLS_VISITED, visited);
+}
+
+void calculate_occlusion() {
+	double start = begin_phase();
+	assign_occlusion_slots();
+
+	struct occlusion_job job;
+	init_job(&job, NULL, OCCLUSION_KERNEL_AUTO, false);
+
+	// Calculate occlusion per face; every column is independent and only reads the world
+	fprintf(stderr, "Calculating face occlusion using %d threads and the %s kernel\n", thread_amount, kernel_names[job.kernel]);
+	parallel_for((int) WORLD_SIZE_XZ, occlude_column, &job);
+	count_traced(&job);
+	end_phase(METRIC_PHASE_OCCLUSION, start);
+}
+
+// Recalculate the listed blocks (by index x + y * size_x + z * size_x * size_y); those without a slot are skipped
+void occlude_blocks(const size_t *blocks, unsigned int amount) {
+	struct occlusion_job job;
+	init_job(&job, blocks, OCCLUSION_KERNEL_AUTO, false);
+
+	parallel_for((int) amount, occlude_listed_block, &job);
+	count_traced(&job);
+}
+
+// Trace every block with an occlusion slot again with the scalar reference kernel; returns the amount of slots that differ, and by how much at most
+unsigned int verify_occlusion(unsigned int *max_difference) {
+	struct occlusion_job job;
+	init_job(&job, NULL, OCCLUSION_KERNEL_SCALAR, true);
+	parallel_for((int) WORLD_SIZE_XZ, occlude_column, &job);
+	*max_difference = atomic_load(&job.max_difference);
+	return atomic_load(&job.mismatches);
+}
+
+// Selects a kernel by name; false if it doesn't exist or the CPU doesn't support it
+bool set_occlusion_kernel(const char *name) {
+	for(int kernel = 0; kernel < OCCLUSION_KERNEL_AMOUNT; kernel++) {
+		if(strcmp(name, kernel_names[kernel]) != 0) {
+			continue;
+		}
+		if(kernel == OCCLUSION_KERNEL_AVX2 && !avx2_supported()) {
+			return false;
+		}
+		occlusion_kernel = kernel;
+		return true;
+	}
+	return false;
+}
+
+// Shorter rays only see the blocks around where they start; the column table depends on the length, and so does which
+// kernel is faster
+void set_ray_length(int cells) {
+	if(cells < 1) {
+		cells = 1;
+	} else if(cells > OFFSET_AMOUNT) {
+		cells = OFFSET_AMOUNT;
+	}
+	if(cells == ray_length) {
+		return;
+	}
+	ray_length = cells;
+	free(ray_columns);
+	ray_columns = NULL;
+	measured_kernel = OCCLUSION_KERNEL_AUTO;
+}
+
+// Call function for every block with an occlusion slot that has a ray reaching (x,y,z) without hitting a solid block first
+void for_each_ray_source(int x, int y, int z, block_function function, void *data) {
+	prepare_rays();
+	prepare_ray_cells();
+
+	for(int r = 0; r < RAY_AMOUNT; r++) {
+		for(int i = 0; i < ray_length; i++) {
+			// Walking the ray backwards only moves away from (x,y,z), so it stays outside once it leaves the world
+			int ox = x - ray_cells[r][i][0];
+			int oy = y - ray_cells[r][i][1];
+			int oz = z - ray_cells[r][i][2];
+			if(!is_inside(ox, oy, oz)) {
+				break;
+			}
+			struct block block = get_block(ox, oy, oz);
+			if(block.type != TYPE_AIR || block.data == 0) {
+				continue;
+			}
+
+			// The cells in between are the same before and after (x,y,z) changes
+			bool reaches = true;
+			for(int j = 0; j < i && reaches; j++) {
+				reaches = !is_solid(ox + ray_cells[r][j][0], oy + ray_cells[r][j][1], oz + ray_cells[r][j][2]);
+			}
+			if(reaches) {
+				function(ox, oy, oz, data);
+			}
+		}
+	}
+}
+
+void free_occlusion() {
+	free(occlusion_rays);
+	occlusion_rays = NULL;
+	free(ray_cells);
+	ray_cells = NULL;
+	free(ray_exits);
+	ray_exits = NULL;
+	free(ray_columns);
+	ray_columns = NULL;
+	free(ray_packets);
+	ray_packets = NULL;
 }
@@ -1,25 +1,47 @@
 #ifndef _OCCLUSION_H
 #define _OCCLUSION_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
 #include "world.h"
 
 #define RAY_AMOUNT 128
-#define OFFSET_AMOUNT 1024
+#define OFFSET_AMOUNT 1024	// Maximum amount of cells a ray crosses
+
+// Ways to trace rays: the DDA walk one ray at a time, packets of rays over precomputed cells, precomputed cells
+// leaping over empty blocks of the occupancy levels, or the DDA walk against the height map, which only applies
+// while the world's blocks are exactly its height map's columns
+#define OCCLUSION_KERNEL_AUTO (-1)
+#define OCCLUSION_KERNEL_SCALAR 0
+#define OCCLUSION_KERNEL_TABLE 1
+#define OCCLUSION_KERNEL_AVX2 2
+#define OCCLUSION_KERNEL_PYRAMID 3
+#define OCCLUSION_KERNEL_HEIGHT_MAP 4
+#define OCCLUSION_KERNEL_AMOUNT 5
 
 struct ray {
 	float x;
 	float y;
 	float z;
+	int step[3];
+	float delta[3];
 	struct directions colliding;
 };
 
-struct offset {
-	int x;
-	int y;
-	int z;
-	//float depth;
-};
+typedef void (*block_function)(int x, int y, int z, void *data);
+
+extern unsigned long long rays_traced;
+extern unsigned long long cells_visited;	// Cells the kernels looked at while tracing those rays
+extern int occlusion_kernel;
+extern int ray_length;	// Cells a ray crosses at most, up to OFFSET_AMOUNT
 
 void calculate_occlusion(void);
+void occlude_blocks(const size_t *blocks, unsigned int amount);
+void for_each_ray_source(int x, int y, int z, block_function function, void *data);
+unsigned int verify_occlusion(unsigned int *max_difference);
+bool set_occlusion_kernel(const char *name);
+void set_ray_length(int cells);
+void free_occlusion(void);
 
 #endif /* !defined _OCCLUSION_H */
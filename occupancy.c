@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "terrain.h"
+#include "occupancy.h"
+#include "metrics.h"
+
+// Globals
+
+uint64_t *occupancy = NULL;
+struct occupancy_level occupancy_levels[OCCUPANCY_LEVELS];
+int solid_height = 0;
+
+// Util functions
+
+// Whether any of the 2x2x2 cells one level down, under the cell of level holding (x,y,z), is solid
+static bool has_solid_children(int level, int x, int y, int z) {
+	int shift = occupancy_levels[level].shift;
+	int first[3] = {x >> shift << shift, y >> shift << shift, z >> shift << shift};
+	int size[3] = {world_size_x, world_size_y, world_size_z};
+	int child_size = 1 << (shift - 1);
+	for(int dz = 0; dz < 2; dz++) {
+		for(int dy = 0; dy < 2; dy++) {
+			for(int dx = 0; dx < 2; dx++) {
+				int child[3] = {first[0] + dx * child_size, first[1] + dy * child_size, first[2] + dz * child_size};
+				if(child[0] >= size[0] || child[1] >= size[1] || child[2] >= size[2]) {
+					continue;
+				}
+				if(level == 0) {
+					if(occupancy[get_brick_index(child[0], child[1], child[2])] != 0) {
+						return true;
+					}
+				} else if(occupancy_levels[level - 1].cells[get_level_index(occupancy_levels + level - 1, child[0], child[1], child[2])] != 0) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+static void build_occupancy_levels(void) {
+	for(int level = 0; level < OCCUPANCY_LEVELS; level++) {
+		struct occupancy_level *current = occupancy_levels + level;
+		current->shift = BRICK_SHIFT + 1 + level;
+		int round = (1 << current->shift) - 1;
+		current->size_x = (world_size_x + round) >> current->shift;
+		current->size_y = (world_size_y + round) >> current->shift;
+		current->size_z = (world_size_z + round) >> current->shift;
+
+		free(current->cells);
+		current->cells = (unsigned char *) malloc((size_t) current->size_x * (size_t) current->size_y * (size_t) current->size_z);
+		if(current->cells == NULL) {
+			fprintf(stderr, "Could not allocate occupancy level %d\n", level);
+			exit(1);
+		}
+
+		int cell_size = 1 << current->shift;
+		for(int z = 0; z < world_size_z; z += cell_size) {
+			for(int y = 0; y < world_size_y; y += cell_size) {
+				for(int x = 0; x < world_size_x; x += cell_size) {
+					current->cells[get_level_index(current, x, y, z)] = has_solid_children(level, x, y, z);
+				}
+			}
+		}
+	}
+}
+
+// Functions
+
+void build_occupancy() {
+	double start = begin_phase();
+	size_t bricks = (size_t) BRICKS_X * (size_t) BRICKS_Y * (size_t) BRICKS_Z;
+	fprintf(stderr, "Building occupancy grid (%zu bricks, %zu KB)\n", bricks, bricks * sizeof(uint64_t) / 1024);
+
+	free(occupancy);
+	occupancy = (uint64_t *) calloc(bricks, sizeof(uint64_t));
+	if(occupancy == NULL) {
+		fprintf(stderr, "Could not allocate occupancy grid\n");
+		exit(1);
+	}
+	solid_height = 0;
+
+	for(int cz = 0; cz < chunks_z; cz++) {
+		for(int cy = 0; cy < chunks_y; cy++) {
+			for(int cx = 0; cx < chunks_x; cx++) {
+				struct chunk *chunk = get_chunk(cx, cy, cz);
+				if(chunk->blocks == NULL && chunk->uniform.type == TYPE_AIR) {
+					continue;
+				}
+				for(int z = cz * CHUNK_SIZE; z < (cz + 1) * CHUNK_SIZE && z < world_size_z; z++) {
+					for(int y = cy * CHUNK_SIZE; y < (cy + 1) * CHUNK_SIZE && y < world_size_y; y++) {
+						for(int x = cx * CHUNK_SIZE; x < (cx + 1) * CHUNK_SIZE && x < world_size_x; x++) {
+							if(get_block(x, y, z).type != TYPE_AIR) {
+								occupancy[get_brick_index(x, y, z)] |= get_brick_bit(x, y, z);
+								if(y >= solid_height) {
+									solid_height = y + 1;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	build_occupancy_levels();
+	end_phase(METRIC_PHASE_OCCUPANCY, start);
+}
+
+// Keeps the levels above the brick of (x,y,z) in step after its block became solid or air
+void update_occupancy_levels(int x, int y, int z, bool solid) {
+	if(solid) {
+		for(int level = 0; level < OCCUPANCY_LEVELS; level++) {
+			occupancy_levels[level].cells[get_level_index(occupancy_levels + level, x, y, z)] = 1;
+		}
+		if(y >= solid_height) {
+			solid_height = y + 1;
+		}
+		return;
+	}
+
+	// Clear upwards while the cells turn empty
+	for(int level = 0; level < OCCUPANCY_LEVELS; level++) {
+		if(has_solid_children(level, x, y, z)) {
+			break;
+		}
+		occupancy_levels[level].cells[get_level_index(occupancy_levels + level, x, y, z)] = 0;
+	}
+}
+
+void free_occupancy() {
+	free(occupancy);
+	occupancy = NULL;
+	for(int level = 0; level < OCCUPANCY_LEVELS; level++) {
+		free(occupancy_levels[level].cells);
+		occupancy_levels[level].cells = NULL;
+	}
+	solid_height = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef _OCCUPANCY_H
+#define _OCCUPANCY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "terrain.h"
+
+// Solidity of every block, one bit each, in bricks of 4x4x4 blocks per 64-bit word
+#define BRICK_SHIFT 2
+#define BRICK_MASK 3
+#define BRICKS_X ((world_size_x + BRICK_MASK) >> BRICK_SHIFT)
+#define BRICKS_Y ((world_size_y + BRICK_MASK) >> BRICK_SHIFT)
+#define BRICKS_Z ((world_size_z + BRICK_MASK) >> BRICK_SHIFT)
+
+// Coarser levels on top of the bricks: a byte per 2x2x2 cells of the level below, set when any block in it is solid
+#define OCCUPANCY_LEVELS 4
+
+struct occupancy_level {
+	int shift;	// Blocks per cell are 1 << shift along every axis
+	int size_x;
+	int size_y;
+	int size_z;
+	unsigned char *cells;
+};
+
+extern uint64_t *occupancy;
+extern struct occupancy_level occupancy_levels[OCCUPANCY_LEVELS];
+extern int solid_height;	// One above the highest solid block; may be higher after blocks were removed
+
+void build_occupancy(void);
+void update_occupancy_levels(int x, int y, int z, bool solid);
+void free_occupancy(void);
+
+static inline int get_brick_index(int x, int y, int z) {
+	return (x >> BRICK_SHIFT) + (y >> BRICK_SHIFT) * BRICKS_X + (z >> BRICK_SHIFT) * BRICKS_X * BRICKS_Y;
+}
+
+static inline uint64_t get_brick_bit(int x, int y, int z) {
+	return 1ULL << ((x & BRICK_MASK) | (y & BRICK_MASK) << BRICK_SHIFT | (z & BRICK_MASK) << (BRICK_SHIFT * 2));
+}
+
+// Index of the cell of a level that holds block (x,y,z), which is inside the world
+static inline size_t get_level_index(const struct occupancy_level *level, int x, int y, int z) {
+	return (size_t) (x >> level->shift) + (size_t) (y >> level->shift) * (size_t) level->size_x + (size_t) (z >> level->shift) * (size_t) level->size_x * (size_t) level->size_y;
+}
+
+// Whether (x,y,z) holds a solid block; the caller guarantees the coordinate is inside the world
+static inline bool is_solid(int x, int y, int z) {
+	return (occupancy[get_brick_index(x, y, z)] & get_brick_bit(x, y, z)) != 0;
+}
+
+static inline bool is_solid_inside(int x, int y, int z) {
+	return is_inside(x, y, z) && is_solid(x, y, z);
+}
+
+static inline void set_solid(int x, int y, int z, bool solid) {
+	if(solid) {
+		occupancy[get_brick_index(x, y, z)] |= get_brick_bit(x, y, z);
+	} else {
+		occupancy[get_brick_index(x, y, z)] &= ~get_brick_bit(x, y, z);
+	}
+	update_occupancy_levels(x, y, z, solid);
+}
+
+#endif /* !defined _OCCUPANCY_H */
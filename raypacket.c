@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "terrain.h"
+#include "occupancy.h"
+#include "raypacket.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+// Portable kernel: every lane walks its precomputed cells on its own, so none waits for the others to end
+unsigned int trace_packet_table(const struct ray_packet *packet, int x, int y, int z, unsigned int *visited_cells) {
+	int bricks_x = BRICKS_X;
+	int bricks_xy = BRICKS_X * BRICKS_Y;
+	int top = (solid_height < world_size_y) ? solid_height : world_size_y;
+
+	int length = ray_length;
+
+	unsigned int hits = 0;
+	unsigned int visited = 0;
+	for(int lane = 0; lane < PACKET_LANES; lane++) {
+		int size_y = packet->rising[lane] ? top : world_size_y;
+		int i;
+		for(i = 0; i < length; i++) {
+			int cx = x + packet->cells[i][0][lane];
+			int cy = y + packet->cells[i][1][lane];
+			int cz = z + packet->cells[i][2][lane];
+
+			// A ray that left the world never comes back in, nor does one that rose above every solid block
+			if((unsigned int) cx >= (unsigned int) world_size_x || (unsigned int) cy >= (unsigned int) size_y || (unsigned int) cz >= (unsigned int) world_size_z) {
+				break;
+			}
+			int brick = (cx >> BRICK_SHIFT) + (cy >> BRICK_SHIFT) * bricks_x + (cz >> BRICK_SHIFT) * bricks_xy;
+			int bit = (cx & BRICK_MASK) | (cy & BRICK_MASK) << BRICK_SHIFT | (cz & BRICK_MASK) << (BRICK_SHIFT * 2);
+			if((occupancy[brick] >> bit) & 1) {
+				hits |= 1u << lane;
+				break;
+			}
+		}
+		visited += (unsigned int) ((i < length) ? i + 1 : i);
+	}
+	*visited_cells += visited;
+	return hits;
+}
+
+#ifdef HAVE_AVX2
+
+bool avx2_supported() {
+	return __builtin_cpu_supports("avx2");
+}
+
+// All lanes in registers; the occupancy of all eight cells is fetched with one gather
+__attribute__((target("avx2")))
+unsigned int trace_packet_avx2(const struct ray_packet *packet, int x, int y, int z, unsigned int *visited_cells) {
+	// Rising lanes end above the highest solid block
+	int top = (solid_height < world_size_y) ? solid_height : world_size_y;
+	int sizes_y[PACKET_LANES];
+	for(int lane = 0; lane < PACKET_LANES; lane++) {
+		sizes_y[lane] = packet->rising[lane] ? top : world_size_y;
+	}
+
+	const __m256i origin_x = _mm256_set1_epi32(x), origin_y = _mm256_set1_epi32(y), origin_z = _mm256_set1_epi32(z);
+	const __m256i size_x = _mm256_set1_epi32(world_size_x), size_z = _mm256_set1_epi32(world_size_z);
+	const __m256i size_y = _mm256_loadu_si256((const __m256i *) sizes_y);
+	const __m256i bricks_x = _mm256_set1_epi32(BRICKS_X), bricks_xy = _mm256_set1_epi32(BRICKS_X * BRICKS_Y);
+	const __m256i minus_one = _mm256_set1_epi32(-1), brick_mask = _mm256_set1_epi32(BRICK_MASK);
+	const __m256i one = _mm256_set1_epi32(1), bit_mask = _mm256_set1_epi32(31), zero = _mm256_setzero_si256();
+	const int *words = (const int *) (const void *) occupancy;	// Little-endian: the low half of a brick comes first
+
+	unsigned int active = (1u << PACKET_LANES) - 1;
+	unsigned int hits = 0;
+	unsigned int visited = 0;
+	int length = ray_length;
+	for(int i = 0; i < length; i++) {
+		visited += (unsigned int) __builtin_popcount(active);
+		__m256i cx = _mm256_add_epi32(origin_x, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) packet->cells[i][0])));
+		__m256i cy = _mm256_add_epi32(origin_y, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) packet->cells[i][1])));
+		__m256i cz = _mm256_add_epi32(origin_z, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) packet->cells[i][2])));
+
+		// A ray that left the world never comes back in, nor does one that rose above every solid block
+		__m256i inside = _mm256_and_si256(
+			_mm256_and_si256(_mm256_cmpgt_epi32(cx, minus_one), _mm256_cmpgt_epi32(size_x, cx)),
+			_mm256_and_si256(
+				_mm256_and_si256(_mm256_cmpgt_epi32(cy, minus_one), _mm256_cmpgt_epi32(size_y, cy)),
+				_mm256_and_si256(_mm256_cmpgt_epi32(cz, minus_one), _mm256_cmpgt_epi32(size_z, cz))
+			)
+		);
+		active &= (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+		if(active == 0) {
+			break;
+		}
+
+		// Each brick is two 32-bit words, so one gather fetches the word holding every lane's cell
+		__m256i brick = _mm256_add_epi32(
+			_mm256_srai_epi32(cx, BRICK_SHIFT),
+			_mm256_add_epi32(
+				_mm256_mullo_epi32(_mm256_srai_epi32(cy, BRICK_SHIFT), bricks_x),
+				_mm256_mullo_epi32(_mm256_srai_epi32(cz, BRICK_SHIFT), bricks_xy)
+			)
+		);
+		__m256i bit = _mm256_or_si256(
+			_mm256_and_si256(cx, brick_mask),
+			_mm256_or_si256(
+				_mm256_slli_epi32(_mm256_and_si256(cy, brick_mask), BRICK_SHIFT),
+				_mm256_slli_epi32(_mm256_and_si256(cz, brick_mask), BRICK_SHIFT * 2)
+			)
+		);
+		__m256i word = _mm256_add_epi32(_mm256_slli_epi32(brick, 1), _mm256_srli_epi32(bit, 5));
+
+		// Lanes outside the world read word 0 instead, and ignore it
+		word = _mm256_and_si256(word, inside);
+		__m256i words_read = _mm256_i32gather_epi32(words, word, 4);
+		__m256i solid_bits = _mm256_and_si256(_mm256_srlv_epi32(words_read, _mm256_and_si256(bit, bit_mask)), one);
+		unsigned int empty = (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(solid_bits, zero)));
+
+		unsigned int solid = active & ~empty;
+		hits |= solid;
+		active &= ~solid;
+		if(active == 0) {
+			break;
+		}
+	}
+	*visited_cells += visited;
+	return hits;
+}
+
+#else
+
+bool avx2_supported() {
+	return false;
+}
+
+unsigned int trace_packet_avx2(const struct ray_packet *packet, int x, int y, int z, unsigned int *visited_cells) {
+	return trace_packet_table(packet, x, y, z, visited_cells);
+}
+
+#endif
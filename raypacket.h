@@ -0,0 +1,28 @@
+#ifndef _RAYPACKET_H
+#define _RAYPACKET_H
+
+#include <stdbool.h>
+
+#include "occlusion.h"
+
+// Neighbouring rays are traced together, one lane each
+#define PACKET_LANES 8
+#define PACKET_AMOUNT (RAY_AMOUNT / PACKET_LANES)
+#define PACKET_BANDS 8	// Latitude bands the packets are formed in
+
+// The cells the rays of a packet cross, as offsets from the block they start in, lanes side by side
+struct ray_packet {
+	short cells[OFFSET_AMOUNT][3][PACKET_LANES];
+	int rays[PACKET_LANES];	// Ray index per lane
+	bool rising[PACKET_LANES];	// Whether the lane's ray goes up, so it can stop above the highest solid block
+};
+
+// Bit per lane whose ray hits a solid block before leaving the world or crossing ray_length cells; adds the cells
+// the lanes looked at to visited_cells
+typedef unsigned int (*packet_kernel)(const struct ray_packet *packet, int x, int y, int z, unsigned int *visited_cells);
+
+unsigned int trace_packet_table(const struct ray_packet *packet, int x, int y, int z, unsigned int *visited_cells);
+bool avx2_supported(void);
+unsigned int trace_packet_avx2(const struct ray_packet *packet, int x, int y, int z, unsigned int *visited_cells);
+
+#endif /* !defined _RAYPACKET_H */
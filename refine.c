@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "refine.h"
+#include "terrain.h"
+#include "occlusion.h"
+#include "mesh.h"
+#include "cache.h"
+
+// Globals
+
+static pthread_t refine_thread;
+static atomic_bool refined = false;
+static int refine_mesh_flags = 0;
+static const char *refine_cache_directory = NULL;
+
+// Functions
+
+static void *refine_world(void *argument) {
+	fprintf(stderr, "Calculating occlusion in the background\n");
+	calculate_occlusion();
+	report_block_memory();
+	fill_vertex_buffer(refine_mesh_flags);
+	if(refine_cache_directory != NULL) {
+		save_baked_world(refine_cache_directory, refine_mesh_flags);
+	}
+
+	// Publishes the new mesh along with the flag
+	atomic_store_explicit(&refined, true, memory_order_release);
+	return NULL;
+}
+
+void start_refining(int mesh_flags, const char *cache_directory) {
+	refine_mesh_flags = mesh_flags;
+	refine_cache_directory = cache_directory;
+	if(pthread_create(&refine_thread, NULL, refine_world, NULL) != 0) {
+		fprintf(stderr, "Could not start the refining thread\n");
+		exit(1);
+	}
+	pthread_detach(refine_thread);
+}
+
+// Once true, the mesh globals hold the occluded mesh and belong to the caller again
+bool is_refined() {
+	return atomic_load_explicit(&refined, memory_order_acquire);
+}
@@ -0,0 +1,11 @@
+#ifndef _REFINE_H
+#define _REFINE_H
+
+#include <stdbool.h>
+
+// Progressive startup: the world goes on screen meshed without occlusion, while a thread calculates the occlusion and
+// meshes it again. The thread owns the blocks, the occlusion and the mesh globals until is_refined() returns true.
+void start_refining(int mesh_flags, const char *cache_directory);
+bool is_refined(void);
+
+#endif /* !defined _REFINE_H */
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "renderbench.h"
+#include "world.h"
+#include "metrics.h"
+#include "util.h"
+
+// Globals
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLSurface surface = EGL_NO_SURFACE;
+static EGLContext context = EGL_NO_CONTEXT;
+
+// Functions
+
+// A pbuffer needs no window system; without one, Mesa's surfaceless platform renders with llvmpipe
+void create_context(int width, int height) {
+	EGLint major, minor;
+	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+			fprintf(stderr, "Could not initialize EGL (error 0x%x)\n", eglGetError());
+			exit(1);
+		}
+	}
+
+	EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint config_amount;
+	if(!eglChooseConfig(display, config_attributes, &config, 1, &config_amount) || config_amount == 0) {
+		fprintf(stderr, "No EGL config for an RGB pbuffer with depth\n");
+		exit(1);
+	}
+
+	EGLint surface_attributes[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+	surface = eglCreatePbufferSurface(display, config, surface_attributes);
+	if(surface == EGL_NO_SURFACE) {
+		fprintf(stderr, "Could not create a %dx%d pbuffer (error 0x%x)\n", width, height, eglGetError());
+		exit(1);
+	}
+
+	// Desktop OpenGL, in the same compatibility profile the window gets
+	eglBindAPI(EGL_OPENGL_API);
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+		fprintf(stderr, "Could not create an OpenGL context (error 0x%x)\n", eglGetError());
+		exit(1);
+	}
+	fprintf(stderr, "EGL %d.%d, %s, OpenGL %s\n", major, minor, glGetString(GL_RENDERER), glGetString(GL_VERSION));
+}
+
+void destroy_context() {
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglDestroySurface(display, surface);
+	eglTerminate(display);
+}
+
+unsigned long long checksum_frame(const unsigned char *pixels, int width, int height) {
+	// FNV-1a over the RGB bytes, bottom row first as GL reads them
+	unsigned long long hash = 14695981039346656037ULL;
+	size_t size = (size_t) width * (size_t) height * 3;
+	for(size_t i = 0; i < size; i++) {
+		hash = (hash ^ pixels[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Binary PPM, top row first
+bool write_frame(const char *directory, int frame, const unsigned char *pixels, int width, int height) {
+	char filename[4096];
+	snprintf(filename, sizeof(filename), "%s/frame-%04d.ppm", directory, frame);
+	FILE *file = fopen(filename, "wb");
+	if(file == NULL) {
+		fprintf(stderr, "Unable to open %s for writing\n", filename);
+		return false;
+	}
+	bool written = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+	size_t row_size = (size_t) width * 3;
+	for(int y = height - 1; y >= 0 && written; y--) {
+		written = fwrite(pixels + (size_t) y * row_size, 1, row_size, file) == row_size;
+	}
+	if(fclose(file) != 0 || !written) {
+		fprintf(stderr, "Could not write %s\n", filename);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	// Parse options; the ones after -- are the world's, as stone takes them
+	int frames = DEFAULT_FRAME_AMOUNT;
+	int width = DEFAULT_VIEWPORT_WIDTH;
+	int height = DEFAULT_VIEWPORT_HEIGHT;
+	bool checksums = false;
+	char *dump_directory = NULL;
+	char *metrics_file = NULL;
+	int c;
+	while((c = getopt(argc, argv, "n:r:co:M:")) != -1) {
+		switch(c) {
+			case 'n':
+				frames = atoi(optarg);
+				break;
+			case 'r':
+				if(sscanf(optarg, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+					fprintf(stderr, "Invalid resolution %s (expected WxH)\n", optarg);
+					return 1;
+				}
+				break;
+			case 'c':
+				checksums = true;
+				break;
+			case 'o':
+				dump_directory = optarg;
+				checksums = true;
+				break;
+			case 'M':
+				metrics_file = optarg;
+				break;
+			case '?':
+			default:
+				fprintf(stderr, "Usage: %s [-n frames] [-r WxH] [-c] [-o dump_directory] [-M metrics_file] [-- world options]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(frames < 1) {
+		fprintf(stderr, "Invalid amount of frames\n");
+		return 1;
+	}
+	if(dump_directory != NULL && mkdir(dump_directory, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Could not create dump directory %s\n", dump_directory);
+		return 1;
+	}
+
+	create_context(width, height);
+
+	// Only fails on the GLX part without an X display, after the GL functions are loaded
+	glewInit();
+	if(!GLEW_VERSION_2_0) {
+		fprintf(stderr, "OpenGL 2.0 not available\n");
+		return 1;
+	}
+
+	// The same state as the window
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glShadeModel(GL_SMOOTH);
+
+	// The world takes the arguments from -- on, with -- in the place of the program name
+	int world_argc = argc - optind + 1;
+	char **world_argv = argv + optind - 1;
+	optind = 1;
+	world_init(world_argc, world_argv);
+	world_reshape(width, height);
+
+	unsigned char *pixels = NULL;
+	if(checksums) {
+		pixels = (unsigned char *) malloc((size_t) width * (size_t) height * 3);
+		if(pixels == NULL) {
+			fprintf(stderr, "Could not allocate a %dx%d frame\n", width, height);
+			return 1;
+		}
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	}
+
+	// Machine-readable results go to stdout, progress to stderr
+	printf("frame,submit_ms,frame_ms,checksum\n");
+	fprintf(stderr, "Rendering %d frames at %dx%d\n", frames, width, height);
+	unsigned long long all_frames = 14695981039346656037ULL;
+	double total = current_time();
+	for(int frame = 0; frame < frames; frame++) {
+		// The camera only depends on the frame number
+		world_tick(FRAME_TICKS);
+
+		// Submitting the commands, and waiting for the frame to be done
+		double start = current_time();
+		world_display();
+		double submitted = current_time();
+		glFinish();
+		double finished = current_time();
+		record_duration(METRIC_HISTOGRAM_SUBMIT, submitted - start);
+		record_duration(METRIC_HISTOGRAM_FRAME, finished - start);
+
+		unsigned long long checksum = 0;
+		if(checksums) {
+			glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+			checksum = checksum_frame(pixels, width, height);
+			all_frames = (all_frames ^ checksum) * 1099511628211ULL;
+			if(dump_directory != NULL && !write_frame(dump_directory, frame, pixels, width, height)) {
+				return 1;
+			}
+		}
+		printf("%d,%.3f,%.3f,%016llx\n", frame, (submitted - start) * 1000.0, (finished - start) * 1000.0, checksum);
+	}
+	total = current_time() - total;
+	fflush(stdout);
+
+	fprintf(stderr, "%d frames in %.3f s (%.1f fps)\n", frames, total, frames / total);
+	fprintf(stderr, "Submit: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n", histogram_percentile(METRIC_HISTOGRAM_SUBMIT, 0.50) * 1000.0, histogram_percentile(METRIC_HISTOGRAM_SUBMIT, 0.95) * 1000.0, histogram_percentile(METRIC_HISTOGRAM_SUBMIT, 0.99) * 1000.0);
+	fprintf(stderr, "Frame: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n", histogram_percentile(METRIC_HISTOGRAM_FRAME, 0.50) * 1000.0, histogram_percentile(METRIC_HISTOGRAM_FRAME, 0.95) * 1000.0, histogram_percentile(METRIC_HISTOGRAM_FRAME, 0.99) * 1000.0);
+	if(checksums) {
+		fprintf(stderr, "Checksum of all frames: %016llx\n", all_frames);
+	}
+
+	if(metrics_file != NULL && !dump_metrics(metrics_file)) {
+		return 1;
+	}
+
+	free(pixels);
+	destroy_context();
+	return 0;
+}
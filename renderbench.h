@@ -0,0 +1,14 @@
+#ifndef _RENDERBENCH_H
+#define _RENDERBENCH_H
+
+#include <stdbool.h>
+
+#define DEFAULT_FRAME_AMOUNT 300
+#define FRAME_TICKS 16	// Milliseconds the camera moves per frame, whatever the frame took
+
+static void create_context(int width, int height);
+static void destroy_context(void);
+static unsigned long long checksum_frame(const unsigned char *pixels, int width, int height);
+static bool write_frame(const char *directory, int frame, const unsigned char *pixels, int width, int height);
+
+#endif /* !defined _RENDERBENCH_H */
@@ -0,0 +1,43 @@
+#version 120
+
+uniform sampler3D colors;
+uniform sampler3D occlusion_right_left_up;
+uniform sampler3D occlusion_down_front_back;
+uniform vec3 world_size;
+
+varying vec3 v_position;
+varying vec3 v_normal;
+
+void main(void) {
+	// The face lies between the solid block it belongs to and the AIR block it faces
+	vec3 block = floor(v_position - v_normal * 0.5);
+	vec3 air = block + v_normal;
+
+	vec3 v_color = texture3D(colors, (block + 0.5) / world_size).rgb * (255.0 / 256.0);
+
+	float v_occlusion = 0.0;
+	if(all(greaterThanEqual(air, vec3(0.0))) && all(lessThan(air, world_size))) {
+		vec3 first = texture3D(occlusion_right_left_up, (air + 0.5) / world_size).rgb;
+		vec3 second = texture3D(occlusion_down_front_back, (air + 0.5) / world_size).rgb;
+		if(v_normal.x > 0.5) {
+			v_occlusion = first.g;
+		} else if(v_normal.x < -0.5) {
+			v_occlusion = first.r;
+		} else if(v_normal.y > 0.5) {
+			v_occlusion = second.r;
+		} else if(v_normal.y < -0.5) {
+			v_occlusion = first.b;
+		} else if(v_normal.z > 0.5) {
+			v_occlusion = second.b;
+		} else {
+			v_occlusion = second.g;
+		}
+	}
+
+	vec3 outside = vec3(1.0, 1.0, 1.0);
+	vec3 inside = vec3(0.2, 0.0, 0.0);
+	vec3 ambient = mix(outside, inside, v_occlusion);
+
+	vec3 color = v_color * ambient;
+	gl_FragColor = vec4(color, 1.0);
+}
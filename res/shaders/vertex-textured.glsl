@@ -0,0 +1,23 @@
+#version 120
+
+uniform mat4 mvp;
+
+attribute vec4 position;	// w: face orientation
+
+varying vec3 v_position;
+varying vec3 v_normal;
+
+void main() {
+	// Outward normals of FACE_POSITIVE_X through FACE_NEGATIVE_Z
+	vec3 normals[6];
+	normals[0] = vec3(1.0, 0.0, 0.0);
+	normals[1] = vec3(-1.0, 0.0, 0.0);
+	normals[2] = vec3(0.0, 1.0, 0.0);
+	normals[3] = vec3(0.0, -1.0, 0.0);
+	normals[4] = vec3(0.0, 0.0, 1.0);
+	normals[5] = vec3(0.0, 0.0, -1.0);
+
+	gl_Position = mvp * vec4(position.xyz, 1.0);
+	v_position = position.xyz;
+	v_normal = normals[int(position.w)];
+}
@@ -1,14 +1,15 @@
 #version 120
 
-attribute vec4 position;
-attribute vec3 color;
-attribute float occlusion;
+uniform mat4 mvp;
+
+attribute vec4 position;	// w: face orientation
+attribute vec4 shading;	// xyz: palette levels, w: quantized occlusion
 
 varying vec3 v_color;
 varying float v_occlusion;
 
 void main() {
-	gl_Position = gl_ModelViewProjectionMatrix * position;
-	v_color = color;
-	v_occlusion = occlusion;
+	gl_Position = mvp * vec4(position.xyz, 1.0);
+	v_color = (64.0 + shading.xyz) / 256.0;
+	v_occlusion = shading.w / 255.0;
 }
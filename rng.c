@@ -0,0 +1,22 @@
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rng.h"
+
+void init_rng(struct rng *rng, uint64_t seed, uint64_t stream) {
+	rng->seed = seed;
+	rng->stream = stream;
+	rng->counter = 0;
+}
+
+uint64_t next_random(struct rng *rng) {
+	return random_at(rng->seed, rng->stream, rng->counter++);
+}
+
+// For when no seed was given; print it so the world can be made again
+uint64_t unpredictable_seed() {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return mix64((uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec) ^ mix64((uint64_t) getpid());
+}
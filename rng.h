@@ -0,0 +1,41 @@
+#ifndef _RNG_H
+#define _RNG_H
+
+#include <stdint.h>
+
+// Independent streams of random numbers derived from one seed
+#define RNG_STREAM_HEIGHT_POINTS 1
+#define RNG_STREAM_HEIGHT_JITTER 2
+#define RNG_STREAM_HEIGHT_NOISE 3
+#define RNG_STREAM_SHADE 4
+#define RNG_STREAM_EDITS 5
+
+// Sequential numbers from one stream, for the places that don't have a position to hash
+struct rng {
+	uint64_t seed;
+	uint64_t stream;
+	uint64_t counter;
+};
+
+// SplitMix64 finalizer
+static inline uint64_t mix64(uint64_t value) {
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+	return value ^ (value >> 31);
+}
+
+// Counter-based: the result depends only on its arguments, so any thread can draw any number in any order
+static inline uint64_t random_at(uint64_t seed, uint64_t stream, uint64_t counter) {
+	return mix64(mix64(seed + stream * 0x9E3779B97F4A7C15ULL) + counter * 0x9E3779B97F4A7C15ULL);
+}
+
+// Uniform in [0, bound)
+static inline unsigned int random_below(uint64_t value, unsigned int bound) {
+	return (unsigned int) (((value >> 32) * bound) >> 32);
+}
+
+void init_rng(struct rng *rng, uint64_t seed, uint64_t stream);
+uint64_t next_random(struct rng *rng);
+uint64_t unpredictable_seed(void);
+
+#endif /* !defined _RNG_H */
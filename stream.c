@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "stream.h"
+#include "terrain.h"
+#include "occupancy.h"
+#include "occlusion.h"
+#include "mesh.h"
+#include "metrics.h"
+#include "util.h"
+
+// Globals
+
+struct region **regions = NULL;
+size_t region_amount = 0;
+static size_t region_capacity = 0;
+
+int stream_height = DEFAULT_WORLD_SIZE_Y;
+static int stream_mesh_flags = 0;
+static int view_radius = DEFAULT_VIEW_RADIUS;
+static size_t memory_budget = (size_t) DEFAULT_MEMORY_BUDGET * 1024 * 1024;
+static region_function release_region = NULL;
+static bool budget_warned = false;
+
+// Regions for the baking thread, oldest first; it bakes with the world globals, so one region at a time
+static pthread_t bake_thread;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_filled = PTHREAD_COND_INITIALIZER;
+static struct region *bake_queue[BAKE_QUEUE_DEPTH];
+static int queued_amount = 0;
+
+// Util functions
+
+// From (x,z) to the nearest block column of a region, squared
+static float region_distance(int rx, int rz, float x, float z) {
+	float dx = fmaxf(fmaxf((float) (rx * REGION_SIZE) - x, x - (float) ((rx + 1) * REGION_SIZE)), 0.0f);
+	float dz = fmaxf(fmaxf((float) (rz * REGION_SIZE) - z, z - (float) ((rz + 1) * REGION_SIZE)), 0.0f);
+	return dx * dx + dz * dz;
+}
+
+static struct region *find_region(int x, int z) {
+	for(size_t i = 0; i < region_amount; i++) {
+		if(regions[i]->x == x && regions[i]->z == z) {
+			return regions[i];
+		}
+	}
+	return NULL;
+}
+
+// The nearest region in view that isn't known yet; false when all of them are
+static bool find_missing_region(float x, float z, int *rx, int *rz) {
+	int center_x = (int) floorf(x / REGION_SIZE);
+	int center_z = (int) floorf(z / REGION_SIZE);
+	int reach = view_radius / REGION_SIZE + 1;
+	float radius = (float) view_radius * (float) view_radius;
+	float nearest = radius;
+	bool found = false;
+	for(int j = center_z - reach; j <= center_z + reach; j++) {
+		for(int i = center_x - reach; i <= center_x + reach; i++) {
+			float distance = region_distance(i, j, x, z);
+			if(distance <= nearest && (!found || distance < nearest) && find_region(i, j) == NULL) {
+				nearest = distance;
+				*rx = i;
+				*rz = j;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+static void free_region(struct region *region) {
+	free(region->vertices);
+	free(region->face_vertex_offsets);
+	free(region->chunk_bounds);
+	free(region);
+}
+
+// Baking
+
+// Copy the mesh of the chunks inside the apron out of the baked world
+static void keep_inner_chunks(struct region *region) {
+	int apron = REGION_APRON >> CHUNK_SHIFT;
+	int inner_x = chunks_x - 2 * apron;
+	size_t chunk_amount = (size_t) inner_x * (size_t) chunks_y * (size_t) (chunks_z - 2 * apron);
+
+	// The chunks of a row along x are next to each other in the mesh
+	unsigned int total = 0;
+	for(int cz = apron; cz < chunks_z - apron; cz++) {
+		for(int cy = 0; cy < chunks_y; cy++) {
+			size_t first = (size_t) (apron + cy * chunks_x + cz * chunks_x * chunks_y);
+			total += face_vertex_offsets[(first + (size_t) inner_x) * FACE_AMOUNT] - face_vertex_offsets[first * FACE_AMOUNT];
+		}
+	}
+	region->vertices = (struct vertex *) malloc(sizeof(struct vertex) * (total > 0 ? total : 1));
+	region->face_vertex_offsets = (unsigned int *) malloc(sizeof(unsigned int) * (chunk_amount * FACE_AMOUNT + 1));
+	region->chunk_bounds = (struct mesh_bounds *) malloc(sizeof(struct mesh_bounds) * chunk_amount);
+	if(region->vertices == NULL || region->face_vertex_offsets == NULL || region->chunk_bounds == NULL) {
+		fprintf(stderr, "Could not allocate the mesh of region (%d,%d)\n", region->x, region->z);
+		exit(1);
+	}
+
+	size_t chunk = 0;
+	unsigned int written = 0;
+	for(int cz = apron; cz < chunks_z - apron; cz++) {
+		for(int cy = 0; cy < chunks_y; cy++) {
+			size_t first = (size_t) (apron + cy * chunks_x + cz * chunks_x * chunks_y);
+			unsigned int from = face_vertex_offsets[first * FACE_AMOUNT];
+			unsigned int length = face_vertex_offsets[(first + (size_t) inner_x) * FACE_AMOUNT] - from;
+			memcpy(region->vertices + written, vertex_buffer_data + from, sizeof(struct vertex) * length);
+			for(size_t i = 0; i < (size_t) inner_x * FACE_AMOUNT; i++) {
+				region->face_vertex_offsets[chunk * FACE_AMOUNT + i] = face_vertex_offsets[first * FACE_AMOUNT + i] - from + written;
+			}
+			memcpy(region->chunk_bounds + chunk, chunk_bounds + first, sizeof(struct mesh_bounds) * (size_t) inner_x);
+			chunk += (size_t) inner_x;
+			written += length;
+		}
+	}
+	region->face_vertex_offsets[chunk_amount * FACE_AMOUNT] = written;
+	region->vertex_amount = written;
+	region->chunk_amount = chunk_amount;
+
+	// Box around the chunks that have vertices, to cull the whole region at once
+	bool empty = true;
+	for(size_t i = 0; i < chunk_amount; i++) {
+		const struct mesh_bounds *bounds = region->chunk_bounds + i;
+		if(region->face_vertex_offsets[(i + 1) * FACE_AMOUNT] == region->face_vertex_offsets[i * FACE_AMOUNT]) {
+			continue;
+		}
+		if(empty) {
+			region->bounds = *bounds;
+			empty = false;
+			continue;
+		}
+		region->bounds.min.x = fminf(region->bounds.min.x, bounds->min.x);
+		region->bounds.min.y = fminf(region->bounds.min.y, bounds->min.y);
+		region->bounds.min.z = fminf(region->bounds.min.z, bounds->min.z);
+		region->bounds.max.x = fmaxf(region->bounds.max.x, bounds->max.x);
+		region->bounds.max.y = fmaxf(region->bounds.max.y, bounds->max.y);
+		region->bounds.max.z = fmaxf(region->bounds.max.z, bounds->max.z);
+	}
+
+	region->bytes = sizeof(struct vertex) * written + sizeof(unsigned int) * (chunk_amount * FACE_AMOUNT + 1) + sizeof(struct mesh_bounds) * chunk_amount;
+}
+
+// The whole pipeline for the region and its apron, as world_init runs it for a world of that size
+static void bake_region(struct region *region) {
+	double start = begin_phase();
+	set_world_size(REGION_BAKE_SIZE, stream_height, REGION_BAKE_SIZE);
+	set_world_origin(region->x * REGION_SIZE - REGION_APRON, region->z * REGION_SIZE - REGION_APRON);
+	create_noise_height_map();
+	populate_world();
+	build_occupancy();
+	calculate_occlusion();
+	fill_vertex_buffer(stream_mesh_flags);
+	keep_inner_chunks(region);
+
+	// The ray tables of the occlusion stay for the next region
+	free_vertex_buffer();
+	free_occupancy();
+	free_terrain();
+	end_phase(METRIC_PHASE_REGION, start);
+	count_metric(METRIC_COUNTER_REGIONS_BAKED, 1);
+	fprintf(stderr, "Baked region (%d,%d) with %u vertices in %.2f ms\n", region->x, region->z, region->vertex_amount, (current_time() - start) * 1000.0);
+}
+
+static void *bake_regions(void *argument) {
+	for(;;) {
+		pthread_mutex_lock(&queue_lock);
+		while(queued_amount == 0) {
+			pthread_cond_wait(&queue_filled, &queue_lock);
+		}
+		struct region *region = bake_queue[0];
+		queued_amount--;
+		memmove(bake_queue, bake_queue + 1, sizeof(struct region *) * (size_t) queued_amount);
+		pthread_mutex_unlock(&queue_lock);
+
+		atomic_store_explicit(&region->state, REGION_BAKING, memory_order_relaxed);
+		bake_region(region);
+
+		// Publishes the mesh along with the state
+		atomic_store_explicit(&region->state, REGION_BAKED, memory_order_release);
+	}
+	return NULL;
+}
+
+static void request_region(int x, int z) {
+	struct region *region = (struct region *) calloc(1, sizeof(struct region));
+	if(region == NULL) {
+		fprintf(stderr, "Could not allocate region (%d,%d)\n", x, z);
+		exit(1);
+	}
+	region->x = x;
+	region->z = z;
+	atomic_init(&region->state, REGION_QUEUED);
+
+	if(region_amount == region_capacity) {
+		size_t capacity = region_capacity * 2 + 64;
+		struct region **new_regions = (struct region **) realloc(regions, sizeof(struct region *) * capacity);
+		if(new_regions == NULL) {
+			fprintf(stderr, "Could not allocate %zu regions\n", capacity);
+			exit(1);
+		}
+		regions = new_regions;
+		region_capacity = capacity;
+	}
+	regions[region_amount++] = region;
+
+	pthread_mutex_lock(&queue_lock);
+	bake_queue[queued_amount++] = region;
+	pthread_cond_signal(&queue_filled);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+// Functions
+
+// The world seed has to be set already
+void start_streaming(int size_y, int mesh_flags, int radius, size_t budget, region_function release) {
+	stream_height = size_y;
+	stream_mesh_flags = mesh_flags;
+	view_radius = radius;
+	memory_budget = budget;
+	release_region = release;
+
+	// Before the baking thread starts, so every region is baked with rays that stay inside its apron
+	set_ray_length(REGION_APRON);
+	fprintf(stderr, "Streaming regions of %dx%dx%d blocks within %d blocks of the camera, in %.0f MB\n", REGION_SIZE, stream_height, REGION_SIZE, view_radius, (double) memory_budget / (1024 * 1024));
+
+	if(pthread_create(&bake_thread, NULL, bake_regions, NULL) != 0) {
+		fprintf(stderr, "Could not start the baking thread\n");
+		exit(1);
+	}
+}
+
+// Evict the farthest regions out of view while the meshes take more than the budget, then queue the nearest missing ones
+void update_streaming(float x, float z) {
+	size_t bytes = 0;
+	int baking = 0;
+	for(size_t i = 0; i < region_amount; i++) {
+		if(atomic_load_explicit(&regions[i]->state, memory_order_acquire) >= REGION_BAKED) {
+			bytes += regions[i]->bytes;
+		} else {
+			baking++;
+		}
+	}
+
+	float radius = (float) view_radius * (float) view_radius;
+	while(bytes > memory_budget) {
+		size_t farthest = region_amount;
+		float farthest_distance = radius;
+		for(size_t i = 0; i < region_amount; i++) {
+			float distance = region_distance(regions[i]->x, regions[i]->z, x, z);
+			if(distance > farthest_distance && atomic_load_explicit(&regions[i]->state, memory_order_relaxed) >= REGION_BAKED) {
+				farthest = i;
+				farthest_distance = distance;
+			}
+		}
+		if(farthest == region_amount) {
+			break;
+		}
+
+		struct region *region = regions[farthest];
+		bytes -= region->bytes;
+		if(region->buffer != 0) {
+			release_region(region);
+		}
+		free_region(region);
+		regions[farthest] = regions[--region_amount];
+		count_metric(METRIC_COUNTER_REGIONS_EVICTED, 1);
+	}
+
+	int rx, rz;
+	while(baking < BAKE_QUEUE_DEPTH && find_missing_region(x, z, &rx, &rz)) {
+		if(bytes >= memory_budget) {
+			if(!budget_warned) {
+				fprintf(stderr, "The memory budget of %.0f MB doesn't hold every region in view\n", (double) memory_budget / (1024 * 1024));
+				budget_warned = true;
+			}
+			break;
+		}
+		request_region(rx, rz);
+		baking++;
+	}
+}
+
+// The nearest region to (x,z) that still has to be uploaded
+struct region *next_baked_region(float x, float z) {
+	struct region *nearest = NULL;
+	float nearest_distance = 0.0f;
+	for(size_t i = 0; i < region_amount; i++) {
+		float distance = region_distance(regions[i]->x, regions[i]->z, x, z);
+		if((nearest == NULL || distance < nearest_distance) && atomic_load_explicit(&regions[i]->state, memory_order_acquire) == REGION_BAKED) {
+			nearest = regions[i];
+			nearest_distance = distance;
+		}
+	}
+	return nearest;
+}
+
+// The renderer has all of the vertices, so they can go
+void finish_region(struct region *region) {
+	free(region->vertices);
+	region->vertices = NULL;
+	atomic_store_explicit(&region->state, REGION_RESIDENT, memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "terrain.h"
+#include "mesh.h"
+
+// Streamed worlds are noise terrain without an end, baked in square regions around the camera. Every region is baked
+// with an apron of its neighbours' blocks around it, and only the chunks inside the apron are kept. Occlusion rays
+// cross at most as many cells as the apron is wide, so they never leave the baked blocks: a block is as bright as in
+// any other region, and the edges of regions meet without seams. The rays are shorter than in a world that is baked
+// whole, so streamed terrain only gets the occlusion of what is near.
+#define REGION_SHIFT 6
+#define REGION_SIZE (1 << REGION_SHIFT)	// Blocks along x and z
+#define REGION_APRON CHUNK_SIZE	// Whole chunks, and the length of the occlusion rays
+#define REGION_BAKE_SIZE (REGION_SIZE + 2 * REGION_APRON)
+
+#define DEFAULT_VIEW_RADIUS 192	// Blocks
+#define DEFAULT_MEMORY_BUDGET 256	// Megabytes of region meshes
+#define DEFAULT_UPLOAD_BUDGET 2.0	// Milliseconds of uploads per frame
+
+// Regions waiting for or in the bake; few, so the next one is picked for where the camera is by then
+#define BAKE_QUEUE_DEPTH 2
+
+// Region states; only the baking thread moves a region from queued to baked, only the main thread from baked on
+#define REGION_QUEUED 0
+#define REGION_BAKING 1
+#define REGION_BAKED 2	// The mesh is ready to upload
+#define REGION_RESIDENT 3	// Uploaded; the vertices only live in the renderer's buffer
+
+struct region {
+	int x;	// The region's blocks start at (x * REGION_SIZE, 0, z * REGION_SIZE) in the terrain
+	int z;
+	atomic_int state;
+
+	// The kept chunks' mesh, laid out as a world's: bake coordinates, and offsets per chunk and face plus the total
+	struct vertex *vertices;
+	unsigned int vertex_amount;
+	unsigned int *face_vertex_offsets;
+	struct mesh_bounds *chunk_bounds;
+	size_t chunk_amount;
+	struct mesh_bounds bounds;
+	size_t bytes;	// Memory the mesh takes, wherever its vertices are
+
+	// The renderer's vertex buffer, and how much of the mesh it holds
+	unsigned int buffer;
+	unsigned int uploaded;
+};
+
+typedef void (*region_function)(struct region *region);
+
+// Every region the main thread knows of, in no particular order
+extern struct region **regions;
+extern size_t region_amount;
+extern int stream_height;
+
+// Only call these from the main thread
+void start_streaming(int size_y, int mesh_flags, int radius, size_t budget, region_function release);
+void update_streaming(float x, float z);
+struct region *next_baked_region(float x, float z);
+void finish_region(struct region *region);
+
+// Where bake coordinate 0 of a region lies in the terrain, along x or z
+static inline float get_region_origin(int coordinate) {
+	return (float) (coordinate * REGION_SIZE - REGION_APRON);
+}
+
+#endif /* !defined _STREAM_H */
@@ -0,0 +1,596 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "util.h"
+#include "terrain.h"
+#include "heightmap.h"
+#include "occupancy.h"
+#include "thread.h"
+#include "rng.h"
+#include "metrics.h"
+
+// Globals
+
+int world_size_x = DEFAULT_WORLD_SIZE_X;
+int world_size_y = DEFAULT_WORLD_SIZE_Y;
+int world_size_z = DEFAULT_WORLD_SIZE_Z;
+
+// Where block (0,0,0) lies in the terrain, which goes on forever; streamed worlds bake one window of it at a time
+int world_origin_x = 0;
+int world_origin_z = 0;
+
+int chunks_x = 0;
+int chunks_y = 0;
+int chunks_z = 0;
+
+int *height_map = NULL;
+struct chunk *chunks = NULL;
+
+// Everything random about a world derives from its seed; terrain_seed varies the block shades
+uint64_t world_seed = 0;
+unsigned int terrain_seed = 0;
+
+// Whether every column is solid up to its height in height_map and AIR above, as populate_world leaves it
+bool world_matches_height_map = false;
+
+// Occlusion is only stored for AIR blocks next to a solid one; slot 0 is unused
+struct occlusion *occlusion_slots = NULL;
+unsigned int occlusion_slot_amount = 0;
+unsigned int occlusion_slot_capacity = 0;
+
+// Util functions
+
+static inline size_t get_chunk_block_index(int x, int y, int z) {
+	return (size_t) ((x & CHUNK_MASK) | (y & CHUNK_MASK) << CHUNK_SHIFT | (z & CHUNK_MASK) << (CHUNK_SHIFT * 2));
+}
+
+static inline bool same_block(struct block a, struct block b) {
+	return a.type == b.type && a.data == b.data;
+}
+
+void set_block(int x, int y, int z, struct block block) {
+	struct chunk *chunk = get_chunk(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT, z >> CHUNK_SHIFT);
+	if(chunk->blocks == NULL) {
+		if(same_block(chunk->uniform, block)) {
+			return;
+		}
+
+		// Give the chunk its own storage, starting out as a copy of the uniform block
+		chunk->blocks = (struct block *) malloc(sizeof(struct block) * CHUNK_VOLUME);
+		if(chunk->blocks == NULL) {
+			fprintf(stderr, "Could not allocate chunk storage\n");
+			exit(1);
+		}
+		for(int i = 0; i < CHUNK_VOLUME; i++) {
+			chunk->blocks[i] = chunk->uniform;
+		}
+	}
+	chunk->blocks[get_chunk_block_index(x, y, z)] = block;
+}
+
+static inline int get_height(int x, int z) {
+	return height_map[(size_t) x + (size_t) z * (size_t) world_size_x];
+}
+
+static inline void set_height(int x, int z, int height) {
+	height_map[(size_t) x + (size_t) z * (size_t) world_size_x] = height;
+}
+
+// Uses the occupancy grid, so only valid after build_occupancy()
+bool has_neighbors(int x, int y, int z) {
+	return
+		is_solid_inside(x+1, y, z) ||
+		is_solid_inside(x-1, y, z) ||
+		is_solid_inside(x, y+1, z) ||
+		is_solid_inside(x, y-1, z) ||
+		is_solid_inside(x, y, z+1) ||
+		is_solid_inside(x, y, z-1);
+}
+
+static inline unsigned int hash_position(int x, int y, int z) {
+	unsigned int hash = terrain_seed;
+	hash = (hash ^ (unsigned int) x) * 0x85EBCA6BU;
+	hash = (hash ^ (unsigned int) y) * 0xC2B2AE35U;
+	hash = (hash ^ (unsigned int) z) * 0x27D4EB2FU;
+	hash ^= hash >> 15;
+	hash *= 0x2C1B3C6DU;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+// Stone blocks don't store their shade; it is a palette entry picked by position
+unsigned int get_block_shade(int x, int y, int z) {
+	return hash_position(x + world_origin_x, y, z + world_origin_z) & ((1 << (PALETTE_BITS * 3)) - 1);
+}
+
+struct color get_palette_color(unsigned int index) {
+	struct color color;
+	color.r = (float) (64 + (index & (PALETTE_LEVELS - 1))) / 256.0f;
+	color.g = (float) (64 + ((index >> PALETTE_BITS) & (PALETTE_LEVELS - 1))) / 256.0f;
+	color.b = (float) (64 + ((index >> (PALETTE_BITS * 2)) & (PALETTE_LEVELS - 1))) / 256.0f;
+	return color;
+}
+
+struct color get_block_color(int x, int y, int z) {
+	return get_palette_color(get_block_shade(x, y, z));
+}
+
+struct directions get_block_occlusion(struct block block) {
+	struct directions directions = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	if(block.data == 0) {
+		return directions;
+	}
+	struct occlusion *occlusion = occlusion_slots + block.data;
+	directions.right = occlusion->right / 255.0f;
+	directions.left = occlusion->left / 255.0f;
+	directions.up = occlusion->up / 255.0f;
+	directions.down = occlusion->down / 255.0f;
+	directions.front = occlusion->front / 255.0f;
+	directions.back = occlusion->back / 255.0f;
+	return directions;
+}
+
+static void dump_block(int x, int y, int z) {
+	struct block block = get_block(x, y, z);
+	struct color color = get_block_color(x, y, z);
+	struct directions occlusion = get_block_occlusion(block);
+	fprintf(stderr, "Dumping block (%d,%d,%d):\n", x, y, z);
+	fprintf(stderr, "\ttype = %u\n", block.type);
+	if(block.type != TYPE_AIR) {
+		fprintf(stderr, "\tcolor = (%f, %f, %f)\n", color.r, color.g, color.b);
+	} else {
+		fprintf(stderr, "\tocclusion = (%f, %f, %f, %f, %f, %f)\n", occlusion.right, occlusion.left, occlusion.up, occlusion.down, occlusion.front, occlusion.back);
+	}
+}
+
+// World size
+
+bool is_valid_world_size(int x, int y, int z) {
+	if(x <= 0 || y <= 0 || z <= 0 || x > MAX_WORLD_SIZE || y > MAX_WORLD_SIZE || z > MAX_WORLD_SIZE) {
+		return false;
+	}
+	return (size_t) x * (size_t) y * (size_t) z <= INT_MAX;
+}
+
+bool parse_world_size(const char *string, int *x, int *y, int *z) {
+	// Format: XxYxZ, e.g. 128x64x128
+	char trailing;
+	if(sscanf(string, "%dx%dx%d%c", x, y, z, &trailing) != 3) {
+		return false;
+	}
+	return is_valid_world_size(*x, *y, *z);
+}
+
+void set_world_size(int x, int y, int z) {
+	world_size_x = x;
+	world_size_y = y;
+	world_size_z = z;
+}
+
+void set_world_origin(int x, int z) {
+	world_origin_x = x;
+	world_origin_z = z;
+}
+
+void set_world_seed(uint64_t seed) {
+	world_seed = seed;
+	terrain_seed = (unsigned int) random_at(seed, RNG_STREAM_SHADE, 0);
+}
+
+// Height map
+
+// Gradient noise lattice hash
+static inline uint32_t hash_lattice(uint32_t seed, int x, int z) {
+	uint32_t hash = seed ^ ((uint32_t) x * 0x8da6b343u) ^ ((uint32_t) z * 0xd8163841u);
+	hash ^= hash >> 16;
+	hash *= 0x7feb352du;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68bu;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+// Quintic smoothstep between lattice points
+static inline float fade(float t) {
+	return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// The map's shape determines the world's width and depth; size_y = 0 picks the larger of the two as height
+void load_height_map(char *filename, int size_y) {
+	double start = begin_phase();
+	fprintf(stderr, "Loading height map %s\n", filename);
+	struct height_map_data map;
+	if(!read_height_map(filename, &map)) {
+		fprintf(stderr, "Could not load height map %s\n", filename);
+		exit(1);
+	}
+	if(size_y <= 0) {
+		size_y = (map.size_x > map.size_z) ? map.size_x : map.size_z;
+		if(size_y > MAX_WORLD_SIZE) {
+			size_y = MAX_WORLD_SIZE;
+		}
+	}
+	if(map.max_height > size_y) {
+		fprintf(stderr, "Raising world height to %d to fit the height map\n", map.max_height);
+		size_y = map.max_height;
+	}
+	if(!is_valid_world_size(map.size_x, size_y, map.size_z)) {
+		fprintf(stderr, "Height map %s makes a %dx%dx%d world, larger than supported (at most %d blocks along each axis and %d in all)\n", filename, map.size_x, size_y, map.size_z, MAX_WORLD_SIZE, INT_MAX);
+		exit(1);
+	}
+	set_world_size(map.size_x, size_y, map.size_z);
+	height_map = map.heights;
+	end_phase(METRIC_PHASE_HEIGHT_MAP, start);
+}
+
+struct height_point_job {
+	const struct height_point *points;
+	unsigned int amount;
+};
+
+// Height is the weighted average of all height points (weight = distance) with some noise
+static void height_point_row(int z, void *data) {
+	const struct height_point_job *job = (const struct height_point_job *) data;
+	for(int x = 0; x < world_size_x; x++) {
+		float total_height = 0;
+		float total_weight = 0;
+		for(unsigned int i = 0; i < job->amount; i++) {
+			const struct height_point *point = &job->points[i];
+
+			if(x == point->x && z == point->z) {
+				total_height += point->height;
+				total_weight += 1;
+			} else {
+				float weight = (float) (1 / (pow(x - point->x, 2) + pow(z - point->z, 2)));
+				total_height += point->height * weight;
+				total_weight += weight;
+			}
+		}
+
+		uint64_t column = (uint64_t) x + (uint64_t) z * (uint64_t) world_size_x;
+		int height = (int) (total_height / total_weight) + (int) (random_at(world_seed, RNG_STREAM_HEIGHT_JITTER, column) & 1);
+		if(height < 1) {
+			height = 1;
+		}
+		set_height(x, z, height);
+	}
+}
+
+void create_random_height_map() {
+	double start = begin_phase();
+	// Determine amount of points to use
+	unsigned int height_points_amount = (unsigned int) (WORLD_SIZE_XZ / 1500);
+	if(height_points_amount < 3) {
+		height_points_amount = 3;
+	}
+	fprintf(stderr, "Generating %u height points\n", height_points_amount);
+	struct height_point *height_points = (struct height_point *) malloc(sizeof(struct height_point) * height_points_amount);
+	for(unsigned int i = 0; i < height_points_amount; i++) {
+		struct height_point *point = &height_points[i];
+
+		point->x = (int) random_below(random_at(world_seed, RNG_STREAM_HEIGHT_POINTS, i * 3), (unsigned int) world_size_x);
+		point->z = (int) random_below(random_at(world_seed, RNG_STREAM_HEIGHT_POINTS, i * 3 + 1), (unsigned int) world_size_z);
+		point->height = (int) random_below(random_at(world_seed, RNG_STREAM_HEIGHT_POINTS, i * 3 + 2), (unsigned int) world_size_y + 1);
+
+		fprintf(stderr, "\ty = %d at (%d,%d)\n", point->height, point->x, point->z);
+	}
+
+	// Create height map (height for every (x,z) coordinate)
+	fprintf(stderr, "Generating height map\n");
+	height_map = (int *) malloc(sizeof(int) * WORLD_SIZE_XZ);
+	if(height_map == NULL) {
+		fprintf(stderr, "Could not allocate %dx%d height map\n", world_size_x, world_size_z);
+		exit(1);
+	}
+	struct height_point_job job = {height_points, height_points_amount};
+	parallel_for(world_size_z, height_point_row, &job);
+	free(height_points);
+	end_phase(METRIC_PHASE_HEIGHT_MAP, start);
+}
+
+// Sums octaves of gradient noise, each twice the frequency and half the amplitude of the previous one
+static void noise_row(int z, void *data) {
+	unsigned int seed = *(unsigned int *) data;
+	float *row = (float *) malloc(sizeof(float) * (size_t) world_size_x);
+	if(row == NULL) {
+		fprintf(stderr, "Could not allocate height map row\n");
+		exit(1);
+	}
+	for(int x = 0; x < world_size_x; x++) {
+		row[x] = 0.0f;
+	}
+
+	// Wavelengths are powers of two, so lattice cells split the row exactly and their gradients are hashed once per cell;
+	// the lattice is anchored at the origin of the terrain, not of the world
+	int row_start = world_origin_x;
+	int row_end = world_origin_x + world_size_x;
+	float amplitude = 1.0f;
+	for(int octave = 0; octave < NOISE_OCTAVES; octave++) {
+		int shift = NOISE_WAVELENGTH_SHIFT - octave;
+		int wavelength = 1 << shift;
+		float scale = 1.0f / (float) wavelength;
+		uint32_t octave_seed = seed + (uint32_t) octave * 0x9e3779b9u;	// Each octave gets its own lattice
+		int lattice_z = (world_origin_z + z) >> shift;
+		float tz = (float) ((world_origin_z + z) & (wavelength - 1)) * scale;
+		float fade_z = fade(tz);
+
+		for(int lattice_x = row_start >> shift; lattice_x * wavelength < row_end; lattice_x++) {
+			float gradients[4][2];
+			for(int corner = 0; corner < 4; corner++) {
+				uint32_t hash = hash_lattice(octave_seed, lattice_x + (corner & 1), lattice_z + (corner >> 1));
+				gradients[corner][0] = (float) (hash & 0xFFFF) * (2.0f / 65535.0f) - 1.0f;
+				gradients[corner][1] = (float) (hash >> 16) * (2.0f / 65535.0f) - 1.0f;
+			}
+
+			// Dot products of the corner gradients with the offsets to them, blended
+			int cell = lattice_x * wavelength;
+			int start = (cell > row_start) ? cell : row_start;
+			int end = (cell + wavelength < row_end) ? cell + wavelength : row_end;
+			for(int x = start; x < end; x++) {
+				float tx = (float) (x - cell) * scale;
+				float a = gradients[0][0] * tx + gradients[0][1] * tz;
+				float b = gradients[1][0] * (tx - 1.0f) + gradients[1][1] * tz;
+				float c = gradients[2][0] * tx + gradients[2][1] * (tz - 1.0f);
+				float d = gradients[3][0] * (tx - 1.0f) + gradients[3][1] * (tz - 1.0f);
+				float fade_x = fade(tx);
+				float top = a + (b - a) * fade_x;
+				float bottom = c + (d - c) * fade_x;
+				row[x - row_start] += amplitude * (top + (bottom - top) * fade_z);
+			}
+		}
+		amplitude *= 0.5f;
+	}
+
+	// Noise around zero becomes terrain around half the world height
+	for(int x = 0; x < world_size_x; x++) {
+		int height = (int) ((float) world_size_y * (0.5f + row[x] * NOISE_SCALE));
+		if(height < 1) {
+			height = 1;
+		} else if(height > world_size_y) {
+			height = world_size_y;
+		}
+		set_height(x, z, height);
+	}
+	free(row);
+}
+
+// Linear in the area, unlike the height points of create_random_height_map, so it suits large worlds
+void create_noise_height_map() {
+	double start = begin_phase();
+	unsigned int seed = (unsigned int) random_at(world_seed, RNG_STREAM_HEIGHT_NOISE, 0);
+	fprintf(stderr, "Generating height map from %d octaves of noise\n", NOISE_OCTAVES);
+	height_map = (int *) malloc(sizeof(int) * WORLD_SIZE_XZ);
+	if(height_map == NULL) {
+		fprintf(stderr, "Could not allocate %dx%d height map\n", world_size_x, world_size_z);
+		exit(1);
+	}
+	parallel_for(world_size_z, noise_row, &seed);
+	end_phase(METRIC_PHASE_HEIGHT_MAP, start);
+}
+
+// Blocks
+
+// Fills one column of chunks
+static void populate_column(int index, void *data) {
+	int cx = index % chunks_x;
+	int cz = index / chunks_x;
+	struct block stone = {TYPE_STONE, 0};
+	struct block air = {TYPE_AIR, 0};
+
+	// The height range below a column of chunks decides which of them are all stone or all air
+	int min_height = world_size_y;
+	int max_height = 0;
+	for(int z = cz * CHUNK_SIZE; z < (cz + 1) * CHUNK_SIZE && z < world_size_z; z++) {
+		for(int x = cx * CHUNK_SIZE; x < (cx + 1) * CHUNK_SIZE && x < world_size_x; x++) {
+			int height = get_height(x, z);
+			if(height < min_height) {
+				min_height = height;
+			}
+			if(height > max_height) {
+				max_height = height;
+			}
+		}
+	}
+
+	for(int cy = 0; cy < chunks_y; cy++) {
+		struct chunk *chunk = get_chunk(cx, cy, cz);
+		int bottom = cy * CHUNK_SIZE;
+		int top = bottom + CHUNK_SIZE;
+		if(top > world_size_y) {
+			top = world_size_y;
+		}
+
+		if(top <= min_height) {
+			chunk->uniform = stone;
+			continue;
+		}
+		if(bottom >= max_height) {
+			chunk->uniform = air;
+			continue;
+		}
+
+		chunk->uniform = air;
+		chunk->blocks = (struct block *) malloc(sizeof(struct block) * CHUNK_VOLUME);
+		if(chunk->blocks == NULL) {
+			fprintf(stderr, "Could not allocate chunk storage\n");
+			exit(1);
+		}
+		for(int z = cz * CHUNK_SIZE; z < (cz + 1) * CHUNK_SIZE; z++) {
+			for(int y = bottom; y < bottom + CHUNK_SIZE; y++) {
+				for(int x = cx * CHUNK_SIZE; x < (cx + 1) * CHUNK_SIZE; x++) {
+					bool solid = is_inside(x, y, z) && y < get_height(x, z);
+					chunk->blocks[get_chunk_block_index(x, y, z)] = solid ? stone : air;
+				}
+			}
+		}
+	}
+}
+
+void populate_world() {
+	double start = begin_phase();
+	fprintf(stderr, "Generating blocks\n");
+
+	chunks_x = (world_size_x + CHUNK_MASK) >> CHUNK_SHIFT;
+	chunks_y = (world_size_y + CHUNK_MASK) >> CHUNK_SHIFT;
+	chunks_z = (world_size_z + CHUNK_MASK) >> CHUNK_SHIFT;
+	chunks = (struct chunk *) calloc((size_t) chunks_x * (size_t) chunks_y * (size_t) chunks_z, sizeof(struct chunk));
+	if(chunks == NULL) {
+		fprintf(stderr, "Could not allocate %dx%dx%d chunks\n", chunks_x, chunks_y, chunks_z);
+		exit(1);
+	}
+
+	// Columns of chunks don't share anything
+	parallel_for(chunks_x * chunks_z, populate_column, NULL);
+	world_matches_height_map = true;
+	end_phase(METRIC_PHASE_BLOCKS, start);
+}
+
+// Whether a chunk consists of AIR blocks only, chunks outside the world included
+static bool is_air_chunk(int cx, int cy, int cz) {
+	if(cx < 0 || cx >= chunks_x || cy < 0 || cy >= chunks_y || cz < 0 || cz >= chunks_z) {
+		return true;
+	}
+	struct chunk *chunk = get_chunk(cx, cy, cz);
+	return chunk->blocks == NULL && chunk->uniform.type == TYPE_AIR;
+}
+
+// Occlusion slots
+
+void assign_occlusion_slots() {
+	// Uses has_neighbors, so only valid after build_occupancy()
+	unsigned int slot = 0;
+	for(int cz = 0; cz < chunks_z; cz++) {
+		for(int cy = 0; cy < chunks_y; cy++) {
+			for(int cx = 0; cx < chunks_x; cx++) {
+				struct chunk *chunk = get_chunk(cx, cy, cz);
+				if(chunk->blocks == NULL && chunk->uniform.type != TYPE_AIR) {
+					// Solid all the way through
+					continue;
+				}
+				if(
+					is_air_chunk(cx, cy, cz) &&
+					is_air_chunk(cx+1, cy, cz) && is_air_chunk(cx-1, cy, cz) &&
+					is_air_chunk(cx, cy+1, cz) && is_air_chunk(cx, cy-1, cz) &&
+					is_air_chunk(cx, cy, cz+1) && is_air_chunk(cx, cy, cz-1)
+				) {
+					// Open air with no solid block in reach
+					continue;
+				}
+
+				for(int z = cz * CHUNK_SIZE; z < (cz + 1) * CHUNK_SIZE && z < world_size_z; z++) {
+					for(int y = cy * CHUNK_SIZE; y < (cy + 1) * CHUNK_SIZE && y < world_size_y; y++) {
+						for(int x = cx * CHUNK_SIZE; x < (cx + 1) * CHUNK_SIZE && x < world_size_x; x++) {
+							struct block current = get_block(x, y, z);
+							if(current.type != TYPE_AIR) {
+								continue;
+							}
+
+							// Blocks that lost their neighbors to edits give up their slot
+							unsigned int data = 0;
+							if(has_neighbors(x, y, z)) {
+								if(slot == BLOCK_DATA_MASK) {
+									fprintf(stderr, "Too many blocks need occlusion values\n");
+									exit(1);
+								}
+								data = ++slot & BLOCK_DATA_MASK;
+							}
+							if(current.data != data) {
+								current.data = data & BLOCK_DATA_MASK;
+								set_block(x, y, z, current);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	allocate_occlusion_slots(slot + 1);
+}
+
+// Room for the given amount of slots, slot 0 included, all without occlusion
+void allocate_occlusion_slots(unsigned int amount) {
+	free(occlusion_slots);
+	occlusion_slot_amount = amount;
+	occlusion_slot_capacity = amount;
+	occlusion_slots = (struct occlusion *) calloc(amount, sizeof(struct occlusion));
+	if(occlusion_slots == NULL) {
+		fprintf(stderr, "Could not allocate %u occlusion slots\n", amount);
+		exit(1);
+	}
+}
+
+// Give an AIR block that gained a solid neighbor after assign_occlusion_slots() a slot of its own
+bool add_occlusion_slot(int x, int y, int z) {
+	struct block block = get_block(x, y, z);
+	if(block.type != TYPE_AIR || block.data != 0 || !has_neighbors(x, y, z)) {
+		return false;
+	}
+	if(occlusion_slot_amount == BLOCK_DATA_MASK) {
+		fprintf(stderr, "Too many blocks need occlusion values\n");
+		exit(1);
+	}
+
+	// Slots of blocks that lose all of their neighbors are not reused, so keep room for more edits
+	if(occlusion_slot_amount == occlusion_slot_capacity) {
+		unsigned int capacity = occlusion_slot_capacity + occlusion_slot_capacity / 4 + 64;
+		struct occlusion *new_occlusion_slots = (struct occlusion *) realloc(occlusion_slots, sizeof(struct occlusion) * capacity);
+		if(new_occlusion_slots == NULL) {
+			fprintf(stderr, "Could not allocate %u occlusion slots\n", capacity);
+			exit(1);
+		}
+		occlusion_slots = new_occlusion_slots;
+		occlusion_slot_capacity = capacity;
+	}
+	memset(occlusion_slots + occlusion_slot_amount, 0, sizeof(struct occlusion));
+
+	block.data = occlusion_slot_amount++ & BLOCK_DATA_MASK;
+	set_block(x, y, z, block);
+	return true;
+}
+
+void report_block_memory() {
+	// The previous layout kept colour and float occlusion in every block
+	struct float_block {
+		char type;
+		struct color color;
+		struct directions occlusion;
+	};
+
+	size_t chunk_amount = CHUNK_AMOUNT;
+	size_t dense = 0;
+	for(size_t i = 0; i < chunk_amount; i++) {
+		if(chunks[i].blocks != NULL) {
+			dense++;
+		}
+	}
+
+	double megabyte = 1024 * 1024;
+	double blocks = (double) (sizeof(struct chunk) * chunk_amount + sizeof(struct block) * CHUNK_VOLUME * dense) / megabyte;
+	double slots = sizeof(struct occlusion) * (double) occlusion_slot_amount / megabyte;
+	double previous = sizeof(struct float_block) * (double) WORLD_SIZE_XYZ / megabyte;
+	fprintf(stderr, "Block storage: %.2f MB (%.2f MB for %zu of %zu chunks stored + %.2f MB occlusion for %u blocks), %.2f MB with float blocks (%.1fx smaller)\n", blocks + slots, blocks, dense, chunk_amount, slots, occlusion_slot_amount - 1, previous, previous / (blocks + slots));
+}
+
+void free_terrain() {
+	free(height_map);
+	height_map = NULL;
+	world_matches_height_map = false;
+	if(chunks != NULL) {
+		size_t chunk_amount = CHUNK_AMOUNT;
+		for(size_t i = 0; i < chunk_amount; i++) {
+			free(chunks[i].blocks);
+		}
+		free(chunks);
+		chunks = NULL;
+	}
+	free(occlusion_slots);
+	occlusion_slots = NULL;
+	occlusion_slot_amount = 0;
+	occlusion_slot_capacity = 0;
+}
@@ -0,0 +1,90 @@
+#ifndef _TERRAIN_H
+#define _TERRAIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "world.h"
+
+// The world is stored in chunks of 16x16x16 blocks; chunks of identical blocks have no block storage
+#define CHUNK_SHIFT 4
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+#define CHUNK_VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+
+// Gradient noise height maps
+#define NOISE_OCTAVES 5	// At most NOISE_WAVELENGTH_SHIFT + 1
+#define NOISE_WAVELENGTH_SHIFT 7	// 128 blocks between the lattice points of the first octave
+#define NOISE_SCALE 0.9f	// Noise to fraction of the world height
+
+// Vertex positions are shorts, and block and chunk indices are ints, so every size and the volume need to fit
+#define MAX_WORLD_SIZE 32767
+
+#define WORLD_SIZE_XZ ((size_t) world_size_x * (size_t) world_size_z)
+#define WORLD_SIZE_XYZ ((size_t) world_size_x * (size_t) world_size_y * (size_t) world_size_z)
+#define CHUNK_AMOUNT ((size_t) chunks_x * (size_t) chunks_y * (size_t) chunks_z)
+
+extern int world_size_x;
+extern int world_size_y;
+extern int world_size_z;
+extern int world_origin_x;
+extern int world_origin_z;
+
+struct chunk {
+	struct block *blocks;	// NULL when every block equals uniform
+	struct block uniform;
+};
+
+extern int chunks_x;
+extern int chunks_y;
+extern int chunks_z;
+
+extern int *height_map;
+extern struct chunk *chunks;
+extern uint64_t world_seed;
+extern unsigned int terrain_seed;
+extern bool world_matches_height_map;
+extern struct occlusion *occlusion_slots;
+extern unsigned int occlusion_slot_amount;
+
+static inline bool is_inside(int x, int y, int z) {
+	return x >= 0 && x < world_size_x && y >= 0 && y < world_size_y && z >= 0 && z < world_size_z;
+}
+
+static inline struct chunk *get_chunk(int cx, int cy, int cz) {
+	return chunks + cx + cy * chunks_x + cz * chunks_x * chunks_y;
+}
+
+// The caller guarantees (x,y,z) is inside the world
+static inline struct block get_block(int x, int y, int z) {
+	struct chunk *chunk = get_chunk(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT, z >> CHUNK_SHIFT);
+	if(chunk->blocks == NULL) {
+		return chunk->uniform;
+	}
+	return chunk->blocks[(x & CHUNK_MASK) | (y & CHUNK_MASK) << CHUNK_SHIFT | (z & CHUNK_MASK) << (CHUNK_SHIFT * 2)];
+}
+
+void set_block(int x, int y, int z, struct block block);
+bool has_neighbors(int x, int y, int z);
+unsigned int get_block_shade(int x, int y, int z);
+struct color get_palette_color(unsigned int index);
+struct color get_block_color(int x, int y, int z);
+struct directions get_block_occlusion(struct block block);
+void assign_occlusion_slots(void);
+void allocate_occlusion_slots(unsigned int amount);
+bool add_occlusion_slot(int x, int y, int z);
+void report_block_memory(void);
+
+bool is_valid_world_size(int x, int y, int z);
+bool parse_world_size(const char *string, int *x, int *y, int *z);
+void set_world_size(int x, int y, int z);
+void set_world_origin(int x, int z);
+void set_world_seed(uint64_t seed);
+
+void load_height_map(char *filename, int size_y);
+void create_random_height_map(void);
+void create_noise_height_map(void);
+void populate_world(void);
+void free_terrain(void);
+
+#endif /* !defined _TERRAIN_H */
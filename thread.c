@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "thread.h"
+
+#define MAX_THREADS 256
+
+// Globals
+
+int thread_amount = 1;
+
+struct parallel_job {
+	parallel_function function;
+	void *data;
+	int amount;
+	atomic_int next;
+};
+
+// The workers stay around between jobs, waiting for the next generation; one job runs at a time
+static pthread_t workers[MAX_THREADS];
+static int worker_amount = 0;
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static struct parallel_job *current_job = NULL;
+static unsigned long job_generation = 0;
+static int busy_workers = 0;
+static bool stopping = false;
+
+// Set while a thread works on a job, so parallel_for calls from inside one run on that thread alone
+static _Thread_local bool in_job = false;
+
+// Functions
+
+static void run_job(struct parallel_job *job) {
+	// Claim indices one at a time so expensive items don't stall a fixed partition
+	int index;
+	while((index = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < job->amount) {
+		job->function(index, job->data);
+	}
+}
+
+static void *pool_worker(void *argument) {
+	in_job = true;
+	unsigned long generation = (unsigned long) (uintptr_t) argument;	// The last one before the worker started
+	pthread_mutex_lock(&pool_lock);
+	for(;;) {
+		while(job_generation == generation && !stopping) {
+			pthread_cond_wait(&job_ready, &pool_lock);
+		}
+		if(stopping) {
+			break;
+		}
+		generation = job_generation;
+		struct parallel_job *job = current_job;
+		pthread_mutex_unlock(&pool_lock);
+
+		run_job(job);
+
+		pthread_mutex_lock(&pool_lock);
+		if(--busy_workers == 0) {
+			pthread_cond_signal(&job_done);
+		}
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return NULL;
+}
+
+static void stop_pool(void) {
+	pthread_mutex_lock(&pool_lock);
+	stopping = true;
+	pthread_cond_broadcast(&job_ready);
+	pthread_mutex_unlock(&pool_lock);
+	for(int i = 0; i < worker_amount; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	worker_amount = 0;
+	stopping = false;
+}
+
+static void start_pool(void) {
+	for(; worker_amount < thread_amount - 1; worker_amount++) {
+		if(pthread_create(&workers[worker_amount], NULL, pool_worker, (void *) (uintptr_t) job_generation) != 0) {
+			fprintf(stderr, "Could not start worker thread; continuing with %d\n", worker_amount + 1);
+			thread_amount = worker_amount + 1;
+			break;
+		}
+	}
+}
+
+void set_thread_amount(int amount) {
+	if(amount <= 0) {
+		// Use every online processor
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		amount = (online > 0) ? (int) online : 1;
+	}
+	if(amount > MAX_THREADS) {
+		amount = MAX_THREADS;
+	}
+
+	// The workers start with the first job
+	pthread_mutex_lock(&submit_lock);
+	if(worker_amount > 0) {
+		stop_pool();
+	}
+	thread_amount = amount;
+	pthread_mutex_unlock(&submit_lock);
+}
+
+void parallel_for(int amount, parallel_function function, void *data) {
+	struct parallel_job job;
+	job.function = function;
+	job.data = data;
+	job.amount = amount;
+	atomic_init(&job.next, 0);
+
+	// Nothing to share, or already on a job
+	if(amount <= 1 || thread_amount <= 1 || in_job) {
+		run_job(&job);
+		return;
+	}
+
+	// Jobs from different threads take turns
+	pthread_mutex_lock(&submit_lock);
+	if(worker_amount < thread_amount - 1) {
+		start_pool();
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	current_job = &job;
+	busy_workers = worker_amount;
+	job_generation++;
+	pthread_cond_broadcast(&job_ready);
+	pthread_mutex_unlock(&pool_lock);
+
+	// The calling thread works along
+	in_job = true;
+	run_job(&job);
+	in_job = false;
+
+	pthread_mutex_lock(&pool_lock);
+	while(busy_workers > 0) {
+		pthread_cond_wait(&job_done, &pool_lock);
+	}
+	current_job = NULL;
+	pthread_mutex_unlock(&pool_lock);
+	pthread_mutex_unlock(&submit_lock);
+}
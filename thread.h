@@ -0,0 +1,12 @@
+#ifndef _THREAD_H
+#define _THREAD_H
+
+typedef void (*parallel_function)(int index, void *data);
+
+extern int thread_amount;
+
+void set_thread_amount(int amount);
+// Calls function for every index below amount, spread over a pool of workers that stay around between calls
+void parallel_for(int amount, parallel_function function, void *data);
+
+#endif /* !defined _THREAD_H */
@@ -1,9 +1,10 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "util.h"
 
-void *file_contents(const char *filename, GLint *length)
+void *file_contents(const char *filename, int *length)
 {
 	FILE *f = fopen(filename, "r");
 	void *buffer;
@@ -14,13 +15,20 @@ void *file_contents(const char *filename, GLint *length)
 	}
 
 	fseek(f, 0, SEEK_END);
-	*length = (GLint) ftell(f);
+	*length = (int) ftell(f);
 	fseek(f, 0, SEEK_SET);
 
 	buffer = malloc((size_t) (*length+1));
-	*length = (GLint) fread(buffer, 1, (size_t) *length, f);
+	*length = (int) fread(buffer, 1, (size_t) *length, f);
 	fclose(f);
 	((char*)buffer)[*length] = '\0';
 
 	return buffer;
 }
+
+double current_time() {
+	// Monotonic wall clock time in seconds
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec / 1000000000.0;
+}
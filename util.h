@@ -1,8 +1,7 @@
 #ifndef _UTIL_H
 #define _UTIL_H
 
-#include <GL/glew.h>
-
-void *file_contents(const char *filename, GLint *length);
+void *file_contents(const char *filename, int *length);
+double current_time(void);
 
 #endif /* !defined _UTIL_H */
@@ -5,35 +5,78 @@
 #include <assert.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <GL/glew.h>
-#include <GLUT/glut.h>
 
 #include "shader.h"
+#include "terrain.h"
+#include "occupancy.h"
 #include "occlusion.h"
+#include "mesh.h"
+#include "thread.h"
+#include "frustum.h"
+#include "matrix.h"
+#include "edit.h"
+#include "cache.h"
+#include "stream.h"
+#include "refine.h"
+#include "rng.h"
+#include "metrics.h"
 #include "util.h"
 #include "world.h"
 
 // Globals
 
 bool paused = false;
+bool textured = false;
 
 int ticks = 0;
 
-int *height_map;
-struct block *world;
-
-unsigned int vertex_amount = 0;
-unsigned int vertex_capacity = 0;
+unsigned int culled_chunks = 0;
+unsigned int culled_vertices = 0;
+unsigned int back_facing_vertices = 0;
 
 struct vec3 camera_position;
 struct vec3 camera_target;
 
+// Streamed worlds bake regions around the camera in the background and upload them within a time budget per frame
+static bool streaming = false;
+static double upload_budget = DEFAULT_UPLOAD_BUDGET / 1000.0;
+
+// Progressive startup draws the world without occlusion until the refining thread is done; meanwhile the mesh globals
+// are the thread's, so the preview's offsets and bounds are copies
+static bool refining = false;
+static struct {
+	unsigned int *face_vertex_offsets;
+	struct mesh_bounds *chunk_bounds;
+} preview;
+
+// When world_init started, and whether the first frame and the first one with the final mesh are drawn yet
+static double startup_time = 0.0;
+static bool first_frame_drawn = false;
+static bool final_frame_drawn = false;
+
+// Picks the columns that the build and dig keys edit
+static struct rng edit_rng;
+
+// Where the metrics go on exit and on the metrics key; NULL writes them to stdout on the key only
+static char *metrics_file = NULL;
+
 // GL resources
 
 static struct {
-	// Vertex buffer
+	// Vertex buffer, and the index buffer that draws its quads as triangles, for every vertex buffer with up to
+	// index_capacity vertices
 	GLuint vertex_buffer_handle;
-	struct vertex *vertex_buffer_data;
+	GLuint index_buffer_handle;
+	unsigned int vertex_capacity;
+	unsigned int index_capacity;
+
+	// Block colours and occlusion when they're not part of the vertices
+	GLuint attribute_textures[ATTRIBUTE_VOLUME_AMOUNT];
+
+	// Attribute bindings of the vertex buffer, or 0 when the driver has no vertex array objects
+	GLuint vertex_array;
 
 	// Shaders
 	GLuint vertex_shader;
@@ -42,19 +85,18 @@ static struct {
 
 	// Uniforms
 	struct {
-		GLint modelview;
 		GLint mvp;
+		GLint attribute_volumes[ATTRIBUTE_VOLUME_AMOUNT];
+		GLint world_size;
 	} uniforms;
 
-	struct mat4 modelview;
+	struct mat4 projection;
 	struct mat4 mvp;
 
 	// Attributes
 	struct {
 		GLint position;
-		GLint normal;
-		GLint color;
-		GLint occlusion;
+		GLint shading;
 	} attributes;
 } resources;
 
@@ -62,254 +104,280 @@ static struct {
 
 #define BUFFER_OFFSET(n) ((void *) (n))
 
-inline struct block *get_block(int x, int y, int z) {
-	if(x < 0 || x >= WORLD_SIZE_X) {
-		return NULL;
-	}
-	if(y < 0 || y >= WORLD_SIZE_Y) {
-		return NULL;
+static void enable_attribute(GLint location, GLint size, GLenum type, size_t offset) {
+	// Attributes the shaders don't use have no location
+	if(location < 0) {
+		return;
 	}
-	if(z < 0 || z >= WORLD_SIZE_Z) {
-		return NULL;
+	glVertexAttribPointer((GLuint) location, size, type, GL_FALSE, sizeof(struct vertex), BUFFER_OFFSET(offset));
+	glEnableVertexAttribArray((GLuint) location);
+}
+
+static void disable_attribute(GLint location) {
+	if(location >= 0) {
+		glDisableVertexAttribArray((GLuint) location);
 	}
-	return world + x + y * WORLD_SIZE_X + z * WORLD_SIZE_X * WORLD_SIZE_Y;
 }
 
-static inline int get_height(int x, int z) {
-	return height_map[x + z * WORLD_SIZE_X];
+static void enable_vertex_attributes(GLuint vertex_buffer) {
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	enable_attribute(resources.attributes.position, 4, GL_SHORT, offsetof(struct vertex, x));
+	enable_attribute(resources.attributes.shading, 4, GL_UNSIGNED_BYTE, offsetof(struct vertex, shade));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resources.index_buffer_handle);
 }
 
-static inline void set_height(int x, int z, int height) {
-	height_map[x + z * WORLD_SIZE_X] = height;
+// Draw the quads of a range of vertices as triangles
+static void draw_vertices(unsigned int first, unsigned int end) {
+	if(end > first) {
+		glDrawElements(GL_TRIANGLES, (GLsizei) (INDICES_PER_QUAD * ((end - first) / 4)), GL_UNSIGNED_INT, BUFFER_OFFSET(sizeof(unsigned int) * INDICES_PER_QUAD * (first / 4)));
+	}
 }
 
-bool has_neighbors(int x, int y, int z) {
-	struct block *other;
+// Draw the chunks in the view frustum, leaving out the faces that point away from the camera; neighbouring ranges
+// join into one call
+static void draw_chunks(const unsigned int *face_offsets, const struct mesh_bounds *bounds, size_t chunk_amount, const struct frustum *frustum, struct vec3 camera) {
+	unsigned int first = 0;
+	unsigned int end = 0;
+	for(size_t i = 0; i < chunk_amount; i++) {
+		const unsigned int *offsets = face_offsets + i * FACE_AMOUNT;
+		unsigned int amount = offsets[FACE_AMOUNT] - offsets[0];
+		if(amount == 0) {
+			continue;
+		}
+		const struct mesh_bounds *chunk = bounds + i;
+		if(!box_in_frustum(frustum, chunk->min, chunk->max)) {
+			culled_chunks++;
+			culled_vertices += amount;
+			continue;
+		}
 
-	if((other = get_block(x+1, y, z)) != NULL && other->type != TYPE_AIR) {
-		return true;
-	}
-	if((other = get_block(x-1, y, z)) != NULL && other->type != TYPE_AIR) {
-		return true;
-	}
-	if((other = get_block(x, y+1, z)) != NULL && other->type != TYPE_AIR) {
-		return true;
-	}
-	if((other = get_block(x, y-1, z)) != NULL && other->type != TYPE_AIR) {
-		return true;
-	}
-	if((other = get_block(x, y, z+1)) != NULL && other->type != TYPE_AIR) {
-		return true;
-	}
-	if((other = get_block(x, y, z-1)) != NULL && other->type != TYPE_AIR) {
-		return true;
+		// Faces of an orientation can only face the camera when it's in front of the plane of at least one of them
+		bool facing[FACE_AMOUNT];
+		facing[FACE_POSITIVE_X] = camera.x > chunk->min.x;
+		facing[FACE_NEGATIVE_X] = camera.x < chunk->max.x;
+		facing[FACE_POSITIVE_Y] = camera.y > chunk->min.y;
+		facing[FACE_NEGATIVE_Y] = camera.y < chunk->max.y;
+		facing[FACE_POSITIVE_Z] = camera.z > chunk->min.z;
+		facing[FACE_NEGATIVE_Z] = camera.z < chunk->max.z;
+		for(int face = 0; face < FACE_AMOUNT; face++) {
+			unsigned int start = offsets[face];
+			if(offsets[face + 1] == start) {
+				continue;
+			}
+			if(!facing[face]) {
+				back_facing_vertices += offsets[face + 1] - start;
+				continue;
+			}
+			if(start != end) {
+				draw_vertices(first, end);
+				first = start;
+			}
+			end = offsets[face + 1];
+		}
 	}
-
-	return false;
+	draw_vertices(first, end);
 }
 
-static void dump_vertex(struct vertex *vert) {
-	fprintf(stderr, "Dumping vertex:\n");
-	fprintf(stderr, "\tposition = (%f, %f, %f)\n", vert->position.x, vert->position.y, vert->position.z);
-	fprintf(stderr, "\tnormal = (%f, %f, %f)\n", vert->normal.x, vert->normal.y, vert->normal.z);
-	fprintf(stderr, "\tcolor = (%f, %f, %f)\n", vert->color.r, vert->color.g, vert->color.b);
-	fprintf(stderr, "\tocclusion = %f\n", vert->occlusion);
+// Room in the index buffer for the quads of capacity vertices
+static void reserve_indices(unsigned int capacity) {
+	if(capacity <= resources.index_capacity) {
+		return;
+	}
+	unsigned int *indices = create_quad_indices(capacity / 4);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resources.index_buffer_handle);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) (sizeof(unsigned int) * INDICES_PER_QUAD * (capacity / 4)), indices, GL_STATIC_DRAW);
+	free(indices);
+	count_metric(METRIC_COUNTER_BYTES_UPLOADED, sizeof(unsigned int) * INDICES_PER_QUAD * (capacity / 4));
+	resources.index_capacity = capacity;
 }
 
-static void dump_block(struct block *block) {
-	fprintf(stderr, "Dumping block:\n");
-	fprintf(stderr, "\ttype = %d\n", block->type);
-	fprintf(stderr, "\tcolor = (%f, %f, %f)\n", block->color.r, block->color.g, block->color.b);
-	fprintf(stderr, "\tocclusion = (%f, %f, %f, %f, %f, %f)\n", block->occlusion.right, block->occlusion.left, block->occlusion.up, block->occlusion.down, block->occlusion.front, block->occlusion.back);
+// Upload the vertices from first on; the buffers grow with some room for edits when they don't fit
+static void upload_vertices(unsigned int first) {
+	glBindBuffer(GL_ARRAY_BUFFER, resources.vertex_buffer_handle);
+	if(vertex_amount > resources.vertex_capacity) {
+		unsigned int capacity = (vertex_amount + vertex_amount / 16 + 3) & ~3U;
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (sizeof(struct vertex) * capacity), NULL, GL_DYNAMIC_DRAW);
+		reserve_indices(capacity);
+		resources.vertex_capacity = capacity;
+		first = 0;
+	}
+	if(first < vertex_amount) {
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) (sizeof(struct vertex) * first), (GLsizeiptr) (sizeof(struct vertex) * (vertex_amount - first)), vertex_buffer_data + first);
+		count_metric(METRIC_COUNTER_BYTES_UPLOADED, sizeof(struct vertex) * (vertex_amount - first));
+	}
 }
 
-// Height map
-
-static void load_height_map(char *filename) {
-	fprintf(stderr, "Loading height map %s\n", filename);
-	int length;
-	char *data = file_contents(filename, &length);
-	if(data == NULL) {
-		fprintf(stderr, "Could not load height map %s\n", filename);
-		exit(1);
+static void create_attribute_textures(void) {
+	fill_attribute_volumes();
+
+	// Every texture stays bound to a texture unit of its own
+	glGenTextures(ATTRIBUTE_VOLUME_AMOUNT, resources.attribute_textures);
+	for(int i = 0; i < ATTRIBUTE_VOLUME_AMOUNT; i++) {
+		glActiveTexture(GL_TEXTURE0 + (GLenum) i);
+		glBindTexture(GL_TEXTURE_3D, resources.attribute_textures[i]);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, world_size_x, world_size_y, world_size_z, 0, GL_RGB, GL_UNSIGNED_BYTE, attribute_volumes[i]);
+		count_metric(METRIC_COUNTER_BYTES_UPLOADED, 3 * WORLD_SIZE_XYZ);
 	}
+	glActiveTexture(GL_TEXTURE0);
 
-	height_map = (int *) malloc(sizeof(int) * WORLD_SIZE_XZ);
-	for(int z = 0; z < WORLD_SIZE_Z; z++) {
-		for(int x = 0; x < WORLD_SIZE_X; x++) {
-			assert(*data++ == '[');
-			char *end = strchr(data, ']');
-			assert(end != NULL);
-			*end = '\0';
-			int height = atoi(data);
-			assert(height >= 0);
-			data = end + 1;
+	fprintf(stderr, "Uploaded attribute textures (%f MB)\n", (float) (ATTRIBUTE_VOLUME_AMOUNT * 3 * WORLD_SIZE_XYZ) / (1024 * 1024));
+	free_attribute_volumes();
+}
 
-			set_height(x, z, height);
-			fprintf(stderr, "Set height to %d for coordinate (%d,%d)\n", height, x, z);
-		}
-		assert(*data++ == '\n');
-	}
-	assert(*data == '\0');
+// Streaming
+
+static void delete_region_buffer(struct region *region) {
+	glDeleteBuffers(1, &region->buffer);
+	region->buffer = 0;
 }
 
-static void create_random_height_map() {
-	// Determine amount of points to use
-	unsigned int height_points_amount = WORLD_SIZE_XZ / 1500;
-	if(height_points_amount < 3) {
-		height_points_amount = 3;
-	}
-	fprintf(stderr, "Generating %u height points\n", height_points_amount);
-	struct height_point *height_points = (struct height_point *) malloc(sizeof(struct height_point) * height_points_amount);
-	for(unsigned int i = 0; i < height_points_amount; i++) {
-		struct height_point *point = &height_points[i];
-
-		point->x = random() % WORLD_SIZE_X;
-		point->z = random() % WORLD_SIZE_Z;
-		point->height = random() % (WORLD_SIZE_Y + 1);
-
-		fprintf(stderr, "\ty = %d at (%d,%d)\n", point->height, point->x, point->z);
-	}
-
-	// Create height map (height for every (x,z) coordinate)
-	fprintf(stderr, "Generating height map\n");
-	height_map = (int *) malloc(sizeof(int) * WORLD_SIZE_XZ);
-	for(int x = 0; x < WORLD_SIZE_X; x++) {
-		for(int z = 0; z < WORLD_SIZE_Z; z++) {
-			float total_height = 0;
-			float total_weight = 0;
-
-			// Height is the weighted average of all height points (weight = distance) with some noise
-			for(unsigned int i = 0; i < height_points_amount; i++) {
-				struct height_point *point = &height_points[i];
-
-				if(x == point->x && z == point->z) {
-					total_height += point->height;
-					total_weight += 1;
-				} else {
-					float weight = (float) (1 / (pow(x - point->x, 2) + pow(z - point->z, 2)));
-					total_height += point->height * weight;
-					total_weight += weight;
-				}
+// Upload baked regions, nearest first, a slice at a time until the frame's upload budget is spent
+static void upload_regions(void) {
+	double start = begin_phase();
+	bool uploading = false;
+	struct region *region;
+	while(current_time() - start < upload_budget && (region = next_baked_region(camera_position.x, camera_position.z)) != NULL) {
+		uploading = true;
+		if(region->buffer == 0 && region->vertex_amount > 0) {
+			// Regions differ in size, so the indices get some room to spare
+			if(region->vertex_amount > resources.index_capacity) {
+				reserve_indices((region->vertex_amount + region->vertex_amount / 4 + 3) & ~3U);
 			}
+			glGenBuffers(1, &region->buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, region->buffer);
+			glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (sizeof(struct vertex) * region->vertex_amount), NULL, GL_STATIC_DRAW);
+		}
 
-			int height = (int) (total_height / total_weight) + (random() % 2);
-			if(height < 1) {
-				height = 1;
-			}
-			set_height(x, z, height);
+		unsigned int amount = region->vertex_amount - region->uploaded;
+		if(amount > UPLOAD_SLICE_VERTICES) {
+			amount = UPLOAD_SLICE_VERTICES;
+		}
+		if(amount > 0) {
+			glBindBuffer(GL_ARRAY_BUFFER, region->buffer);
+			glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) (sizeof(struct vertex) * region->uploaded), (GLsizeiptr) (sizeof(struct vertex) * amount), region->vertices + region->uploaded);
+			count_metric(METRIC_COUNTER_BYTES_UPLOADED, sizeof(struct vertex) * amount);
+			region->uploaded += amount;
+		}
+		if(region->uploaded == region->vertex_amount) {
+			finish_region(region);
 		}
 	}
+	if(uploading) {
+		end_phase(METRIC_PHASE_UPLOAD, start);
+	}
 }
 
-// VBO
-
-static void create_vertex(int px, int py, int pz, int nx, int ny, int nz, struct color color, GLfloat occlusion) {
-	// Grow the vertex buffer if necessary
-	unsigned int need = vertex_amount + 1;
-	if(need > vertex_capacity) {
-		vertex_capacity += 100;
-		struct vertex *new_vertex_buffer_data = (struct vertex *) realloc(resources.vertex_buffer_data, sizeof(struct vertex) * vertex_capacity);
-		if(new_vertex_buffer_data == NULL) {
-			fprintf(stderr, "Could not allocate enough memory for %u vertices", need);
-			exit(1);
+// Every uploaded region from its own buffer, moved to its place in the terrain
+static void draw_regions(void) {
+	for(size_t i = 0; i < region_amount; i++) {
+		struct region *region = regions[i];
+		if(atomic_load_explicit(&region->state, memory_order_relaxed) != REGION_RESIDENT || region->vertex_amount == 0) {
+			continue;
+		}
+		float x = get_region_origin(region->x);
+		float z = get_region_origin(region->z);
+		struct mat4 mvp = resources.mvp;
+		translate_matrix(&mvp, x, 0.0f, z);
+		struct frustum frustum;
+		extract_frustum(&frustum, &mvp);
+		if(!box_in_frustum(&frustum, region->bounds.min, region->bounds.max)) {
+			culled_chunks += (unsigned int) region->chunk_amount;
+			culled_vertices += region->vertex_amount;
+			continue;
 		}
-		resources.vertex_buffer_data = new_vertex_buffer_data;
+
+		glUniformMatrix4fv(resources.uniforms.mvp, 1, GL_FALSE, (const GLfloat *) &mvp);
+		enable_vertex_attributes(region->buffer);
+		struct vec3 camera = {camera_position.x - x, camera_position.y, camera_position.z - z};
+		draw_chunks(region->face_vertex_offsets, region->chunk_bounds, region->chunk_amount, &frustum, camera);
 	}
+}
 
-	struct vertex *new_vertex = resources.vertex_buffer_data + vertex_amount;
+// Fly over the terrain along x, weaving along z
+static void move_streaming_camera(void) {
+	camera_position.x = (float) ticks * STREAM_CAMERA_SPEED;
+	camera_position.y = (float) stream_height * 1.5f;
+	camera_position.z = (GLfloat) sin((float) ticks / 5000.0f) * (float) REGION_SIZE;
+	camera_target.x = camera_position.x + (float) REGION_SIZE;
+	camera_target.y = (float) stream_height * 0.5f;
+	camera_target.z = camera_position.z;
+}
 
-	new_vertex->position.x = (GLfloat) px;
-	new_vertex->position.y = (GLfloat) py;
-	new_vertex->position.z = (GLfloat) pz;
-	new_vertex->normal.x = (GLfloat) nx;
-	new_vertex->normal.y = (GLfloat) ny;
-	new_vertex->normal.z = (GLfloat) nz;
-	new_vertex->color = color;
-	new_vertex->occlusion = occlusion;
+// Progressive startup
 
-	vertex_amount++;
+// Keep what the preview draws with while the refining thread replaces the mesh globals
+static void copy_preview(void) {
+	size_t chunk_amount = CHUNK_AMOUNT;
+	preview.face_vertex_offsets = (unsigned int *) malloc(sizeof(unsigned int) * (chunk_amount * FACE_AMOUNT + 1));
+	preview.chunk_bounds = (struct mesh_bounds *) malloc(sizeof(struct mesh_bounds) * chunk_amount);
+	if(preview.face_vertex_offsets == NULL || preview.chunk_bounds == NULL) {
+		fprintf(stderr, "Could not allocate the preview mesh offsets\n");
+		exit(1);
+	}
+	memcpy(preview.face_vertex_offsets, face_vertex_offsets, sizeof(unsigned int) * (chunk_amount * FACE_AMOUNT + 1));
+	memcpy(preview.chunk_bounds, chunk_bounds, sizeof(struct mesh_bounds) * chunk_amount);
 }
 
-static void fill_vertex_buffer() {
-	// Bind buffer
-	glBindBuffer(GL_ARRAY_BUFFER, resources.vertex_buffer_handle);
-
-	// Loop through all blocks (and a 1 block layer outside the map to 'look at' the outer faces)
-	for(int x = -1; x <= WORLD_SIZE_X; x++) {
-		for(int y = -1; y <= WORLD_SIZE_Y; y++) {
-			for(int z = -1; z <= WORLD_SIZE_Z; z++) {
-				struct block *current = get_block(x, y, z);
-				if(current != NULL && current->type != TYPE_AIR) {
-					// Only create vertices from the empty layer around the map or an AIR block
-					continue;
-				}
+// Swap the occluded mesh in for the preview, in between two frames
+static void finish_refining(void) {
+	double start = begin_phase();
+	upload_vertices(0);
+	if(textured) {
+		glDeleteTextures(ATTRIBUTE_VOLUME_AMOUNT, resources.attribute_textures);
+		create_attribute_textures();
+	}
+	end_phase(METRIC_PHASE_UPLOAD, start);
 
-				// Check the blocks directly adjacent to the six faces of the current empty block
-				struct block *other;
+	free(preview.face_vertex_offsets);
+	preview.face_vertex_offsets = NULL;
+	free(preview.chunk_bounds);
+	preview.chunk_bounds = NULL;
+	refining = false;
+}
 
-				// Positive x
-				if((other = get_block(x+1, y, z)) != NULL && other->type != TYPE_AIR) {
-					float occlusion = (current == NULL) ? 0.0f : current->occlusion.right;
-					create_vertex(x+1, y, z, -1, 0, 0, other->color, occlusion);
-					create_vertex(x+1, y, z+1, -1, 0, 0, other->color, occlusion);
-					create_vertex(x+1, y+1, z+1, -1, 0, 0, other->color, occlusion);
-					create_vertex(x+1, y+1, z, -1, 0, 0, other->color, occlusion);
-				}
-				// Negative x
-				if((other = get_block(x-1, y, z)) != NULL && other->type != TYPE_AIR) {
-					float occlusion = (current == NULL) ? 0.0f : current->occlusion.left;
-					create_vertex(x, y, z+1, 1, 0, 0, other->color, occlusion);
-					create_vertex(x, y, z, 1, 0, 0, other->color, occlusion);
-					create_vertex(x, y+1, z, 1, 0, 0, other->color, occlusion);
-					create_vertex(x, y+1, z+1, 1, 0, 0, other->color, occlusion);
-				}
-				// Positive y
-				if((other = get_block(x, y+1, z)) != NULL && other->type != TYPE_AIR) {
-					float occlusion = (current == NULL) ? 0.0f : current->occlusion.up;
-					create_vertex(x+1, y+1, z+1, 0, -1, 0, other->color, occlusion);
-					create_vertex(x+1, y+1, z, 0, -1, 0, other->color, occlusion);
-					create_vertex(x, y+1, z, 0, -1, 0, other->color, occlusion);
-					create_vertex(x, y+1, z+1, 0, -1, 0, other->color, occlusion);
-				}
-				// Negative y
-				if((other = get_block(x, y-1, z)) != NULL && other->type != TYPE_AIR) {
-					float occlusion = (current == NULL) ? 0.0f : current->occlusion.down;
-					create_vertex(x, y, z, 0, 1, 0, other->color, occlusion);
-					create_vertex(x+1, y, z, 0, 1, 0, other->color, occlusion);
-					create_vertex(x+1, y, z+1, 0, 1, 0, other->color, occlusion);
-					create_vertex(x, y, z+1, 0, 1, 0, other->color, occlusion);
-				}
-				// Positive z
-				if((other = get_block(x, y, z+1)) != NULL && other->type != TYPE_AIR) {
-					float occlusion = (current == NULL) ? 0.0f : current->occlusion.front;
-					create_vertex(x+1, y, z+1, 0, 0, -1, other->color, occlusion);
-					create_vertex(x, y, z+1, 0, 0, -1, other->color, occlusion);
-					create_vertex(x, y+1, z+1, 0, 0, -1, other->color, occlusion);
-					create_vertex(x+1, y+1, z+1, 0, 0, -1, other->color, occlusion);
-				}
-				// Negative z
-				if((other = get_block(x, y, z-1)) != NULL && other->type != TYPE_AIR) {
-					float occlusion = (current == NULL) ? 0.0f : current->occlusion.back;
-					create_vertex(x, y, z, 0, 0, 1, other->color, occlusion);
-					create_vertex(x, y+1, z, 0, 0, 1, other->color, occlusion);
-					create_vertex(x+1, y+1, z, 0, 0, 1, other->color, occlusion);
-					create_vertex(x+1, y, z, 0, 0, 1, other->color, occlusion);
-				}
-			}
-		}
+// Time to the first frame, and to the first one that looks as it should
+static void report_startup(void) {
+	if(!first_frame_drawn) {
+		end_phase(METRIC_PHASE_FIRST_FRAME, startup_time);
+		fprintf(stderr, "First frame after %.2f ms\n", (current_time() - startup_time) * 1000.0);
+		first_frame_drawn = true;
 	}
+	if(!final_frame_drawn && !refining && !streaming) {
+		end_phase(METRIC_PHASE_FINAL_FRAME, startup_time);
+		fprintf(stderr, "Final frame after %.2f ms\n", (current_time() - startup_time) * 1000.0);
+		final_frame_drawn = true;
+	}
+}
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(struct vertex) * vertex_amount, resources.vertex_buffer_data, GL_STATIC_DRAW);
+static void dump_metrics_on_exit(void) {
+	dump_metrics(metrics_file);
 }
 
 // Main functions
 
 void world_init(int argc, char **argv) {
+	startup_time = current_time();
+
 	// Parse options
 	char *vertex_shader_file = NULL, *fragment_shader_file = NULL, *height_map_file = NULL;
+	int threads = 0;
+	int size_x = 0, size_y = 0, size_z = 0;
+	int mesh_flags = 0;
+	char *cache_directory = "cache";
+	bool noise = false;
+	bool progressive = false;
+	bool seeded = false;
+	uint64_t seed = 0;
+	int view_radius = 0;
+	size_t memory_budget = (size_t) DEFAULT_MEMORY_BUDGET * 1024 * 1024;
 	int c;
-	while((c = getopt(argc, argv, "v:f:m:")) != -1) {
+	while((c = getopt(argc, argv, "v:f:m:t:d:s:c:M:S:B:U:CgTNP")) != -1) {
 		switch(c) {
 			case 'v':
 				vertex_shader_file = optarg;
@@ -320,6 +388,58 @@ void world_init(int argc, char **argv) {
 			case 'm':
 				height_map_file = optarg;
 				break;
+			case 't':
+				threads = atoi(optarg);
+				break;
+			case 'g':
+				mesh_flags |= MESH_GREEDY;
+				break;
+			case 'T':
+				mesh_flags |= MESH_TEXTURED;
+				textured = true;
+				break;
+			case 'd':
+				if(!parse_world_size(optarg, &size_x, &size_y, &size_z)) {
+					fprintf(stderr, "Invalid world size %s (expected XxYxZ, at most %d blocks along each axis)\n", optarg, MAX_WORLD_SIZE);
+					exit(1);
+				}
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 10);
+				seeded = true;
+				break;
+			case 'c':
+				cache_directory = optarg;
+				break;
+			case 'C':
+				cache_directory = NULL;
+				break;
+			case 'N':
+				noise = true;
+				break;
+			case 'P':
+				progressive = true;
+				break;
+			case 'M':
+				metrics_file = optarg;
+				break;
+			case 'S':
+				view_radius = atoi(optarg);
+				if(view_radius <= 0) {
+					fprintf(stderr, "Invalid view radius %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'B':
+				if(atoi(optarg) <= 0) {
+					fprintf(stderr, "Invalid memory budget %s (in megabytes)\n", optarg);
+					exit(1);
+				}
+				memory_budget = (size_t) atoi(optarg) * 1024 * 1024;
+				break;
+			case 'U':
+				upload_budget = atof(optarg) / 1000.0;
+				break;
 			case '?':
 			default:
 				fprintf(stderr, "Invalid arguments\n");
@@ -331,54 +451,107 @@ void world_init(int argc, char **argv) {
 
 	// Default options
 	if(vertex_shader_file == NULL) {
-		vertex_shader_file = "res/shaders/vertex.glsl";
+		vertex_shader_file = textured ? "res/shaders/vertex-textured.glsl" : "res/shaders/vertex.glsl";
 	}
 	if(fragment_shader_file == NULL) {
-		fragment_shader_file = "res/shaders/fragment.glsl";
+		fragment_shader_file = textured ? "res/shaders/fragment-textured.glsl" : "res/shaders/fragment.glsl";
 	}
 
-	fprintf(stderr, "World size: %dx%dx%d\n", WORLD_SIZE_X, WORLD_SIZE_Y, WORLD_SIZE_Z);
+	set_thread_amount(threads);
+	if(metrics_file != NULL) {
+		atexit(dump_metrics_on_exit);
+	}
 
-	// Create height map
-	if(height_map_file != NULL) {
-		load_height_map(height_map_file);
+	// Streamed worlds are baked region by region in the background, from the first frame on
+	if(view_radius > 0) {
+		if(height_map_file != NULL || textured) {
+			fprintf(stderr, "Streamed worlds are noise terrain without attribute textures, so -S goes with neither -m nor -T\n");
+			exit(1);
+		}
+		if(!seeded) {
+			seed = unpredictable_seed();
+		}
+		set_world_seed(seed);
+		fprintf(stderr, "Seed %llu\n", (unsigned long long) world_seed);
+		streaming = true;
+		start_streaming((size_y > 0) ? size_y : DEFAULT_WORLD_SIZE_Y, mesh_flags, view_radius, memory_budget, delete_region_buffer);
 	} else {
-		create_random_height_map();
-	}
-
-	// Populate world with blocks
-	fprintf(stderr, "Generating blocks\n");
-	world = (struct block *) malloc(sizeof(struct block) * WORLD_SIZE_XYZ);
-	for(int x = 0; x < WORLD_SIZE_X; x++) {
-		for(int z = 0; z < WORLD_SIZE_Z; z++) {
-			int height = get_height(x, z);
-
-			for(int y = 0; y < WORLD_SIZE_Y; y++) {
-				struct block *current = get_block(x, y, z);
-
-				if(y < height) {
-					current->type = TYPE_STONE;
-					current->color.r = (64 + random() % 16) / 256.0f;
-					current->color.g = (64 + random() % 16) / 256.0f;
-					current->color.b = (64 + random() % 16) / 256.0f;
-				} else {
-					current->type = TYPE_AIR;
-				}
+		// Create height map
+		if(height_map_file != NULL) {
+			load_height_map(height_map_file, size_y);
+
+			// Without a seed a loaded map still looks the same every time, so its bake can come from the cache
+			if(!seeded) {
+				seed = hash_height_map();
+			}
+			set_world_seed(seed);
+		} else {
+			// A world from an unpredictable seed never comes back, so its bake would only fill up the cache
+			if(!seeded) {
+				seed = unpredictable_seed();
+				cache_directory = NULL;
+			}
+			set_world_seed(seed);
+			if(size_x > 0) {
+				set_world_size(size_x, size_y, size_z);
+			}
+			if(noise) {
+				create_noise_height_map();
+			} else {
+				create_random_height_map();
+			}
+		}
+		fprintf(stderr, "World size: %dx%dx%d, seed %llu\n", world_size_x, world_size_y, world_size_z, (unsigned long long) world_seed);
+		init_rng(&edit_rng, world_seed, RNG_STREAM_EDITS);
+
+		// Populate world with blocks
+		populate_world();
+		build_occupancy();
+
+		if(cache_directory != NULL && load_baked_world(cache_directory, mesh_flags)) {
+			report_block_memory();
+		} else if(progressive) {
+			// Without occlusion every face is as bright as it gets; the occlusion follows once the preview is uploaded
+			fprintf(stderr, "Creating vertex buffer without occlusion\n");
+			fill_vertex_buffer(mesh_flags);
+			refining = true;
+		} else {
+			// Calculate occlusion values
+			fprintf(stderr, "Calculating occlusion\n");
+			calculate_occlusion();
+			report_block_memory();
+
+			// Create VBO
+			fprintf(stderr, "Creating vertex buffer\n");
+			fill_vertex_buffer(mesh_flags);
+
+			if(cache_directory != NULL) {
+				save_baked_world(cache_directory, mesh_flags);
 			}
 		}
 	}
 
-	// Calculate occlusion values
-	fprintf(stderr, "Calculating occlusion\n");
-	calculate_occlusion();
-
-	// Create VBO
-	fprintf(stderr, "Creating vertex buffer\n");
+	double start = begin_phase();
 	glGenBuffers(1, &resources.vertex_buffer_handle);
-	fill_vertex_buffer();
-	fprintf(stderr, "Filled vertex buffer with %u vertices (%f MB)\n", vertex_amount, (sizeof(struct vertex) * vertex_amount) / (float)(1024 * 1024));
+	glGenBuffers(1, &resources.index_buffer_handle);
+	if(!streaming) {
+		upload_vertices(0);
+		fprintf(stderr, "Filled vertex buffer with %u vertices (%f MB)\n", vertex_amount, (sizeof(struct vertex) * vertex_amount) / (float)(1024 * 1024));
+	}
+
+	if(textured) {
+		create_attribute_textures();
+	}
+	end_phase(METRIC_PHASE_UPLOAD, start);
+
+	// Nothing reads the blocks or the mesh globals from here on until the refining thread is done
+	if(refining) {
+		copy_preview();
+		start_refining(mesh_flags, cache_directory);
+	}
 
 	// Create shaders
+	start = begin_phase();
 	resources.vertex_shader = make_shader(GL_VERTEX_SHADER, vertex_shader_file);
 	if(!resources.vertex_shader) {
 		exit(1);
@@ -391,22 +564,52 @@ void world_init(int argc, char **argv) {
 	if(!resources.program) {
 		exit(1);
 	}
+	end_phase(METRIC_PHASE_SHADERS, start);
 
 	// Bind program variables
-	resources.uniforms.modelview = glGetUniformLocation(resources.program, "modelview");
 	resources.uniforms.mvp = glGetUniformLocation(resources.program, "mvp");
 	resources.attributes.position = glGetAttribLocation(resources.program, "position");
-	resources.attributes.normal = glGetAttribLocation(resources.program, "normal");
-	resources.attributes.color = glGetAttribLocation(resources.program, "color");
-	resources.attributes.occlusion = glGetAttribLocation(resources.program, "occlusion");
+	resources.attributes.shading = glGetAttribLocation(resources.program, "shading");
+	resources.uniforms.attribute_volumes[ATTRIBUTE_VOLUME_COLOR] = glGetUniformLocation(resources.program, "colors");
+	resources.uniforms.attribute_volumes[ATTRIBUTE_VOLUME_OCCLUSION_RIGHT_LEFT_UP] = glGetUniformLocation(resources.program, "occlusion_right_left_up");
+	resources.uniforms.attribute_volumes[ATTRIBUTE_VOLUME_OCCLUSION_DOWN_FRONT_BACK] = glGetUniformLocation(resources.program, "occlusion_down_front_back");
+	resources.uniforms.world_size = glGetUniformLocation(resources.program, "world_size");
+
+	// Attribute textures use a texture unit each
+	glUseProgram(resources.program);
+	for(int i = 0; i < ATTRIBUTE_VOLUME_AMOUNT; i++) {
+		glUniform1i(resources.uniforms.attribute_volumes[i], i);
+	}
+	if(!streaming) {
+		glUniform3f(resources.uniforms.world_size, (GLfloat) world_size_x, (GLfloat) world_size_y, (GLfloat) world_size_z);
+	}
+
+	// The program, the vertex attributes and the clear values never change, so they're set once
+	if(GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object) {
+		glGenVertexArrays(1, &resources.vertex_array);
+		glBindVertexArray(resources.vertex_array);
+		enable_vertex_attributes(resources.vertex_buffer_handle);
+	}
+	glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
+	glClearDepth(1.0f);
+	world_reshape(DEFAULT_VIEWPORT_WIDTH, DEFAULT_VIEWPORT_HEIGHT);
 
 	// Set camera position and target
-	camera_position.x = WORLD_SIZE_X * 0.0f;
-	camera_position.y = WORLD_SIZE_Y * 1.2f;
-	camera_position.z = WORLD_SIZE_Z * 1.2f;
-	camera_target.x = WORLD_SIZE_X * 0.5f;
-	camera_target.y = WORLD_SIZE_Y * 0.5f;
-	camera_target.z = WORLD_SIZE_Z * 0.5f;
+	if(streaming) {
+		move_streaming_camera();
+		return;
+	}
+	camera_position.x = world_size_x * 0.0f;
+	camera_position.y = world_size_y * 1.2f;
+	camera_position.z = world_size_z * 1.2f;
+	camera_target.x = world_size_x * 0.5f;
+	camera_target.y = world_size_y * 0.5f;
+	camera_target.z = world_size_z * 0.5f;
+}
+
+void world_reshape(int width, int height) {
+	glViewport(0, 0, width, height);
+	perspective_matrix(&resources.projection, 60.0f, (float) width / (float) (height > 0 ? height : 1), 0.1f, 1024.0f);
 }
 
 void world_tick(int delta) {
@@ -415,50 +618,112 @@ void world_tick(int delta) {
 	}
 
 	ticks += delta;
+	if(streaming) {
+		move_streaming_camera();
+		return;
+	}
 
 	// Move camera position
-	camera_position.x = (GLfloat) sin(ticks / 1500.0f) * WORLD_SIZE_X * 1.1f + WORLD_SIZE_X * 0.5f;
-	camera_position.y = (GLfloat) cos(ticks / 3500.0f) * WORLD_SIZE_Y * 1.1f + WORLD_SIZE_Y * 0.75f;
-	camera_position.z = (GLfloat) cos(ticks / 1500.0f) * WORLD_SIZE_Z * 1.1f + WORLD_SIZE_Z * 0.5f;
+	camera_position.x = (GLfloat) sin(ticks / 1500.0f) * world_size_x * 1.1f + world_size_x * 0.5f;
+	camera_position.y = (GLfloat) cos(ticks / 3500.0f) * world_size_y * 1.1f + world_size_y * 0.75f;
+	camera_position.z = (GLfloat) cos(ticks / 1500.0f) * world_size_z * 1.1f + world_size_z * 0.5f;
 }
 
 void world_display() {
-	glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
-	glClearDepth(1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glUseProgram(resources.program);
-
-	// Set uniforms
-	glUniformMatrix4fv(resources.uniforms.modelview, 1, GL_FALSE, (const GLfloat *) &resources.modelview);
+	// Position camera
+	struct vec3 up = {0.0f, 1.0f, 0.0f};
+	struct mat4 view;
+	look_at_matrix(&view, camera_position, camera_target, up);
+	multiply_matrices(&resources.mvp, &resources.projection, &view);
 	glUniformMatrix4fv(resources.uniforms.mvp, 1, GL_FALSE, (const GLfloat *) &resources.mvp);
 
-	// Vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, resources.vertex_buffer_handle);
-	glVertexAttribPointer((GLuint) resources.attributes.position, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), BUFFER_OFFSET(0));
-	glEnableVertexAttribArray((GLuint) resources.attributes.position);
-	glVertexAttribPointer((GLuint) resources.attributes.normal, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), BUFFER_OFFSET(sizeof(struct vec3)));
-	glEnableVertexAttribArray((GLuint) resources.attributes.normal);
-	glVertexAttribPointer((GLuint) resources.attributes.color, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), BUFFER_OFFSET(sizeof(struct vec3) * 2));
-	glEnableVertexAttribArray((GLuint) resources.attributes.color);
-	glVertexAttribPointer((GLuint) resources.attributes.occlusion, 1, GL_FLOAT, GL_FALSE, sizeof(struct vertex), BUFFER_OFFSET(sizeof(struct vec3) * 2 + sizeof(struct color)));
-	glEnableVertexAttribArray((GLuint) resources.attributes.occlusion);
+	// Draw the visible chunks
+	culled_chunks = 0;
+	culled_vertices = 0;
+	back_facing_vertices = 0;
+	if(streaming) {
+		update_streaming(camera_position.x, camera_position.z);
+		upload_regions();
+		draw_regions();
+	} else {
+		if(refining && is_refined()) {
+			finish_refining();
+		}
+		if(resources.vertex_array == 0) {
+			enable_vertex_attributes(resources.vertex_buffer_handle);
+		}
 
-	glPushMatrix();
+		// Skip the chunks outside the view frustum
+		struct frustum frustum;
+		extract_frustum(&frustum, &resources.mvp);
+		if(refining) {
+			draw_chunks(preview.face_vertex_offsets, preview.chunk_bounds, CHUNK_AMOUNT, &frustum, camera_position);
+		} else {
+			draw_chunks(face_vertex_offsets, chunk_bounds, CHUNK_AMOUNT, &frustum, camera_position);
+		}
+	}
 
-	// Position camera
-	gluLookAt(camera_position.x, camera_position.y, camera_position.z, camera_target.x, camera_target.y, camera_target.z, 0.0f, 1.0f, 0.0f);
+	if(resources.vertex_array == 0) {
+		disable_attribute(resources.attributes.position);
+		disable_attribute(resources.attributes.shading);
+	}
+	report_startup();
+}
 
-	// Draw quads, starting at offset 0, and specify the amount
-	glDrawArrays(GL_QUADS, 0, (GLsizei) vertex_amount);
+void world_set_block(int x, int y, int z, unsigned int type) {
+	// Streamed regions don't keep their blocks, and the refining thread has them until it's done
+	if(streaming || refining) {
+		return;
+	}
+	double start = current_time();
+	struct edit edit;
+	if(!edit_block(x, y, z, type, &edit)) {
+		return;
+	}
+
+	upload_vertices(edit.first_vertex);
+
+	// Colour and occlusion of the changed blocks
+	if(textured) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for(unsigned int i = 0; i < edit.block_amount; i++) {
+			size_t index = edit.blocks[i];
+			int bx = (int) (index % (size_t) world_size_x);
+			int by = (int) (index / (size_t) world_size_x % (size_t) world_size_y);
+			int bz = (int) (index / ((size_t) world_size_x * (size_t) world_size_y));
+			unsigned char values[ATTRIBUTE_VOLUME_AMOUNT][3];
+			get_block_attributes(bx, by, bz, values);
+			for(int j = 0; j < ATTRIBUTE_VOLUME_AMOUNT; j++) {
+				glActiveTexture(GL_TEXTURE0 + (GLenum) j);
+				glTexSubImage3D(GL_TEXTURE_3D, 0, bx, by, bz, 1, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, values[j]);
+			}
+			count_metric(METRIC_COUNTER_BYTES_UPLOADED, sizeof(values));
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
 
-	glPopMatrix();
+	fprintf(stderr, "Set block (%d,%d,%d) to %u in %.2f ms (%.2f ms for %u blocks occluded and %u chunks meshed again)\n", x, y, z, type, (current_time() - start) * 1000.0, edit.seconds * 1000.0, edit.block_amount, edit.chunk_amount);
+	free_edit(&edit);
+}
 
-	// Clean up
-	glDisableVertexAttribArray((GLuint) resources.attributes.position);
-	glDisableVertexAttribArray((GLuint) resources.attributes.normal);
-	glDisableVertexAttribArray((GLuint) resources.attributes.color);
-	glDisableVertexAttribArray((GLuint) resources.attributes.occlusion);
+// Dig out the top block of a random column, or build one on top of it
+static void edit_random_column(bool build) {
+	if(streaming || refining) {
+		return;
+	}
+	int x = (int) random_below(next_random(&edit_rng), (unsigned int) world_size_x);
+	int z = (int) random_below(next_random(&edit_rng), (unsigned int) world_size_z);
+	int y = world_size_y - 1;
+	while(y >= 0 && !is_solid(x, y, z)) {
+		y--;
+	}
+	if(build) {
+		world_set_block(x, y + 1, z, TYPE_STONE);
+	} else if(y >= 0) {
+		world_set_block(x, y, z, TYPE_AIR);
+	}
 }
 
 void world_keyboard(unsigned char key, int x, int y) {
@@ -466,6 +731,20 @@ void world_keyboard(unsigned char key, int x, int y) {
 		case 'p':	// Pause
 			paused = !paused;
 			break;
+		case 'b':	// Build
+			edit_random_column(true);
+			break;
+		case 'd':	// Dig
+			edit_random_column(false);
+			break;
+		case 'm':	// Metrics
+			if(metrics_file != NULL) {
+				dump_metrics(metrics_file);
+			} else {
+				write_metrics(stdout);
+				fflush(stdout);
+			}
+			break;
 	}
 }
 
@@ -3,28 +3,49 @@
 
 #include <stdbool.h>
 
-#define WORLD_SIZE_X 128
-#define WORLD_SIZE_Y 64
-#define WORLD_SIZE_Z 128
+#define DEFAULT_WORLD_SIZE_X 128
+#define DEFAULT_WORLD_SIZE_Y 64
+#define DEFAULT_WORLD_SIZE_Z 128
 
-#define WORLD_SIZE_XZ WORLD_SIZE_X * WORLD_SIZE_Z
-#define WORLD_SIZE_XYZ WORLD_SIZE_X * WORLD_SIZE_Y * WORLD_SIZE_Z
+#define DEFAULT_VIEWPORT_WIDTH 1024
+#define DEFAULT_VIEWPORT_HEIGHT 768
+
+// Streamed worlds: how fast the camera flies, and how much of a region's mesh goes to GL in one call
+#define STREAM_CAMERA_SPEED 0.02f	// Blocks per millisecond
+#define UPLOAD_SLICE_VERTICES 4096
 
 #define TYPE_AIR 0
 #define TYPE_STONE 1
 
+// Stone shades: 16 levels per channel, packed into a palette index
+#define PALETTE_BITS 4
+#define PALETTE_LEVELS (1 << PALETTE_BITS)
+
+// Face orientations, by outward normal
+#define FACE_POSITIVE_X 0
+#define FACE_NEGATIVE_X 1
+#define FACE_POSITIVE_Y 2
+#define FACE_NEGATIVE_Y 3
+#define FACE_POSITIVE_Z 4
+#define FACE_NEGATIVE_Z 5
+#define FACE_AMOUNT 6
+
+// Block data is 24 bits wide
+#define BLOCK_DATA_MASK 0xFFFFFF
+
 struct vec3 {
-	GLfloat x;
-	GLfloat y;
-	GLfloat z;
+	float x;
+	float y;
+	float z;
 };
 
+// Aligned, so a vec4 loads into one SIMD register
 struct vec4 {
-	GLfloat x;
-	GLfloat y;
-	GLfloat z;
-	GLfloat w;
-};
+	float x;
+	float y;
+	float z;
+	float w;
+} __attribute__((aligned(16)));
 
 struct mat4 {
 	struct vec4 x;
@@ -34,9 +55,9 @@ struct mat4 {
 };
 
 struct color {
-	GLfloat r;
-	GLfloat g;
-	GLfloat b;
+	float r;
+	float g;
+	float b;
 };
 
 struct directions {
@@ -48,17 +69,29 @@ struct directions {
 	float back;
 };
 
+// Occlusion per face, quantized to 0-255
+struct occlusion {
+	unsigned char right;
+	unsigned char left;
+	unsigned char up;
+	unsigned char down;
+	unsigned char front;
+	unsigned char back;
+};
+
 struct block {
-	char type;
-	struct color color;
-	struct directions occlusion;
+	unsigned int type : 8;
+	unsigned int data : 24;	// Palette index for solid blocks, occlusion slot (0 = none) for AIR blocks
 };
 
+// 12 bytes: integer corner position with the face orientation, palette levels and quantized occlusion
 struct vertex {
-	struct vec3 position;
-	struct vec3 normal;
-	struct color color;
-	GLfloat occlusion;
+	short x;
+	short y;
+	short z;
+	short face;
+	unsigned char shade[3];
+	unsigned char occlusion;
 };
 
 struct height_point {
@@ -67,12 +100,16 @@ struct height_point {
 	int height;
 };
 
-struct block *get_block(int x, int y, int z);
-bool has_neighbors(int x, int y, int z);
+// Chunks and vertices left out of the last frame: outside the view frustum, or facing away from the camera
+extern unsigned int culled_chunks;
+extern unsigned int culled_vertices;
+extern unsigned int back_facing_vertices;
 
 void world_init(int argc, char **argv);
+void world_reshape(int width, int height);
 void world_tick(int delta);
 void world_display(void);
+void world_set_block(int x, int y, int z, unsigned int type);
 void world_keyboard(unsigned char key, int x, int y);
 void world_mouse(int button, int state, int x, int y);
 